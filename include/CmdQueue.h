@@ -0,0 +1,81 @@
+/**
+ * @file CmdQueue.h
+ * @author Doug Fajardo
+ * @brief  Lock-free job queue between a session's input and its executor.
+ * @version 0.1
+ * @date 2024-09-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * A session's input side (the serial receive task) splits, tokenizes
+ * and looks up each command, and queues it as a cmdJob_t. An executor
+ * task takes the jobs, in order, and runs them.
+ *
+ * Each queue is a single-producer / single-consumer ring: only the
+ * producer moves 'head', only the consumer moves 'tail', so no lock
+ * is needed. Jobs are built and run in place (claim/publish,
+ * next/release) - nothing is copied through the ring.
+ * If the ring is full, the producer waits (the UART buffer holds the
+ * input meanwhile). An empty ring blocks the consumer on its task
+ * notification.
+ *
+ * A session has two queues (lanes - see Commands.h). A slow lane job
+ * carries a fence: how many jobs had been queued on the fast lane
+ * before it. The slow executor waits (done()) until the fast lane has
+ * run all of those, so 'setpwm ...' then 'commit' saves the new limits,
+ * and 'macro end' then 'macro save' saves the whole macro.
+ */
+#ifndef C_M_D_Q_U_E_U_E__H
+#define C_M_D_Q_U_E_U_E__H
+#include <atomic>
+#include "Config.h"
+#include "Commands.h"
+
+// What a job is
+enum jobKind_t : uint8_t
+{
+  JOB_TEXT,         // a text command (cmd is nullptr if it wasn't found)
+  JOB_BINARY,       // a binary frame - cmd with decoded args
+  JOB_BIN_REPLY,    // just send a binary reply (a bad frame)
+  JOB_BATCH_BEGIN,  // start a servo batch (';' separated line)
+  JOB_BATCH_END     // ... and end it
+};
+
+struct cmdJob_t
+{
+  jobKind_t kind;
+  bool firstOfLine;             // first command of its line? (for stats)
+  uint8_t tokCnt;
+  uint8_t tokOfs[MAX_ARGS];     // where each token is, in text[]
+  uint8_t opcode;               // binary: opcode, and the reply status
+  uint8_t status;
+  const cmdList_t *cmd;
+  cmdArgs_t args;               // binary: decoded args
+  uint32_t rxStamp;             // Stats::now() when the line started arriving
+  uint32_t eolStamp;            // ... and when it was complete
+  uint32_t fence;               // slow lane: fast lane jobs queued before this one
+  char text[CMD_BUF_LEN];       // text: the tokenized command (NUL after each token)
+};
+
+class CmdQueue
+{
+private:
+  cmdJob_t jobs[CMD_QUEUE_LEN];
+  std::atomic<uint32_t> head;   // next job to fill (producer only)
+  std::atomic<uint32_t> tail;   // next job to run (consumer only)
+  TaskHandle_t consumer;
+
+public:
+  CmdQueue();
+  void begin(TaskHandle_t consumerTask);
+
+  cmdJob_t *claim();    // producer: the next empty job (waits if full)
+  void publish();       // producer: hand that job to the consumer
+  cmdJob_t *next();     // consumer: the next job (waits if none)
+  void release();       // consumer: done with that job
+
+  uint32_t queued();    // jobs published so far (a fence)
+  void waitDone(uint32_t fence);  // wait until that many jobs have been released
+};
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * @file Cobs.h
+ * @author Doug Fajardo
+ * @brief  COBS framing and CRC-16 for binary command frames
+ * @version 0.1
+ * @date 2024-09-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * A binary frame on the wire (see Commands.h - BINARY FRAMES):
+ *         0x00  <COBS encoded payload>  0x00
+ * and the decoded payload ends with a CRC-16/CCITT (poly 0x1021, 
+ * init 0xFFFF) of the bytes before it, low byte first.
+ *
+ * CobsRx collects the frame from the incoming bytes, Cobs::unframe()
+ * decodes and checks it. Plain C++ - no Arduino - so it can be tested
+ * on the host (test/test_cobs: pio test -e native).
+ */
+#ifndef C_O_B_S__H
+#define C_O_B_S__H
+#include <stdint.h>
+
+#define BIN_FRAME_DELIM  0x00
+#define BIN_BUF_LEN      32       // Longest (encoded) frame we accept
+
+// Cobs::unframe() failures
+#define COBS_BAD         -1       // not valid COBS (or nothing in it)
+#define COBS_BAD_CRC     -2       // decoded (buf[0] is the opcode) - but too short, or the CRC is wrong
+
+class Cobs
+{
+public:
+  static int decode(uint8_t *buf, int len);
+  static int encode(const uint8_t *in, int len, uint8_t *out);
+  static uint16_t crc16(const uint8_t *buf, int len);
+  static int unframe(uint8_t *buf, int len);
+};
+
+
+/**
+ * @brief Collects one binary frame at a time from a stream of bytes.
+ *   The first 0x00 starts a frame, the next 0x00 ends it. A frame 
+ *   longer than BIN_BUF_LEN is dropped.
+ */
+class CobsRx
+{
+private:
+  bool inFrame;
+
+public:
+  enum rxEvent_t
+  {
+    RX_NONE,       // nothing to do
+    RX_START,      // a frame started (or an empty one - a resync)
+    RX_FRAME,      // a frame is complete: buf[0 ... len-1]
+    RX_DROPPED     // the frame was too long - dropped (back to text)
+  };
+
+  uint8_t buf[BIN_BUF_LEN];   // the encoded frame (no delimiters)
+  int len;
+
+  CobsRx();
+  void reset();
+  rxEvent_t push(uint8_t ch);
+  bool active() const { return (inFrame); }   // true while a frame is being collected
+};
+
+#endif
@@ -10,25 +10,64 @@
  *  recvdChar(char ch) (or recvStr) build up a command line, and when a 
  *  end-of-line is seen (as determined by user-supplied
  *  function isThisEOL()), the line is parsed into 'tokens'
- *  (words separated by spaces).
+ *  (words separated by spaces). A quoted token ("My Net") may
+ *  contain spaces. Tokens are split in place in this session's
+ *  own buffer, so several sessions may parse at the same time.
+ *  A line may hold several commands separated by ';'. They are
+ *  run as one servo batch - all their servo moves land together.
  *
- *  The first token is the command name - we search for it in 
- *  the commandList array. The search is NOT case-sensitive.
+ *  The first token is the command name - we look it up in 
+ *  the command index. The search is NOT case-sensitive.
  *  If found, we check to see if the number of tokens is between
  *  the minTokCount and maxTokCount, inclusive.  If not, we 
- *  continue searching.
+ *  continue searching (the same name may appear more than once,
+ *  with different token counts).
+ *
+ *  The command index is a hash table built from one or more
+ *  command lists. The built-in list lives in CommandList.h; other
+ *  modules (Servos, Prefs, ...) may add their own list by calling
+ *  Commands::addCmdList() from their setup/begin routine. Each
+ *  entry's name hash is computed at compile time (see cmdHash()),
+ *  so a lookup costs one runtime hash of the token plus (usually)
+ *  one strcasecmp.
  * 
- *  If the number of tokens is correct, we will execute the
- *  indicated function. 
+ *  If the number of tokens is correct, the command is queued for
+ *  this session's executor (see CmdQueue.h), which runs the indicated
+ *  function on its own task - so input keeps flowing while a command
+ *  runs. Commands flagged CMD_SLOW (flash writes, reboot) go to a
+ *  second, lower priority, executor so servo commands are not held
+ *  up behind them. A CMD_SLOW_VERB command (macro) goes there only 
+ *  when its first arg is a flash writing verb ('save', 'delete'). 
+ *  A slow command still waits for every fast lane command typed 
+ *  before it, so 'setpwm ...' then 'commit' saves the new limits.
+ *  Fast lane commands typed after it do NOT wait for it - Prefs and
+ *  Macros lock their data, so they see it before or after, never
+ *  half written. (Replies from the two lanes may interleave)
+ *  'wait' and 'macro run' DO run on the fast lane - on purpose: a 
+ *  wait times the commands after it, so everything behind it in the
+ *  fast lane (servo and binary commands too) waits with it.
+ *  A command is one of two kinds:
  * 
- *  THE COMMAND has the following format:
- *     void cmdfunction(Print *devOut, char *tokens[], int tokens)
+ *  TOKEN COMMANDS (free-form args - help, macro ...) have the format:
+ *     void cmdfunction(Stream *devOut, int tokCnt, char *tokens[])
  * 
- *     devOut is a pointer to an instance of the Print class. This
+ *     devOut is a pointer to an instance of the Stream class. This
  *     should be used to send responses to the originator of the command.
+ *     (It is the session's ResponseBuf - the response is collected, and
+ *     sent in one piece when the command returns)
  * 
  *     tokens[] is an array of string pointers for each token found. 
  *     tokCnt is the number of tokens present. 
+ *     The function sends its own OK_RESPONSE / ERR_RESPONSE.
+ * 
+ *  SCHEMA COMMANDS have an argument schema - one argSpec_t (type,
+ *  range, label) per argument. The dispatcher decodes AND range checks
+ *  every argument, in one pass, into a cmdArgs_t before the call:
+ *     bool execfunction(Stream *devOut, const cmdArgs_t *args)
+ *  It returns true if it worked - the dispatcher then sends
+ *  OK_RESPONSE (or ERR_RESPONSE). A bad argument never reaches it.
+ *  The same schema decodes binary frames, so text and binary
+ *  commands share one validation path.
  * 
  * 
  *  Some additional 'helper' functions are available to help decode the
@@ -40,27 +79,195 @@
  *            This can be helpfull to build the command list before the
  *            actual commands are present.
  * 
+ *  BINARY FRAMES:
+ *  A session also accepts binary frames, mixed in with text lines.
+ *  A 0x00 byte (never present in a text line) starts a frame, and the
+ *  next 0x00 ends it:
+ *         0x00  <COBS encoded payload>  0x00
+ *  The decoded payload is:
+ *         <opcode> <args...> <crc16 low> <crc16 high>
+ *  Each arg is a fixed-width little-endian integer, sized by its type
+ *  in the command's schema (ARG_INT8, ARG_SERVO: 1 byte, ARG_INT16,
+ *  ARG_CDEG: 2, ARG_INT32: 4). ARG_STR args are text only.
+ *  The CRC is CRC-16/CCITT (poly 0x1021, init 0xFFFF) over opcode+args.
+ *  The opcode selects the cmdList entry with that opcode. Its args are
+ *  range checked, and its 'exec' function is called - exactly as for
+ *  the text command.
+ *  The reply is a frame with the payload <opcode> <status> <crc16>
+ *  (status is one of the BIN_xxx codes below) - no text is sent.
+ *  A 6 servo setpoint is 13 bytes of payload, 18 bytes on the wire.
  * 
  */
 #include "config.h"
 #include "Prefs.h"
+#include "ResponseBuf.h"
+#include "Stats.h"
+#include "NameHash.h"
+#include "Cobs.h"
+#include "Tokenizer.h"
 
 #ifndef C_O_M_M_A_N_D_S___H
 #define C_O_M_M_A_N_D_S___H
 
-#define CMD_BUF_LEN 80
+#define CMD_BUF_LEN 160
 #define CMD_BUF_CHARS (CMD_BUF_LEN-1)
 
+// Maximum number of arguments for any command.
+#define MAX_ARGS  8
+// Commands on one line (see Tokenizer.h - CMD_SEPARATOR)
+#define MAX_CMDS_PER_LINE 10
+// Defines what constitutes a 'comment' in the cmd list
+#define COMMENT "*COMMENT*"
+
+// Size of the command index (MUST be a power of 2).
+//   Keep this at least twice the total number of commands.
+#define CMD_HASH_SIZE   128
+// Commands with a handler time histogram (see 'stats'). Any more are
+//   not timed.
+#define CMD_STATS_SIZE  48
+// How many command lists may be added with addCmdList()
+#define MAX_CMD_LISTS   8
+
+// - - - BINARY FRAMES  (framing - see Cobs.h)
+#define BIN_MAX_OPCODE   64       // opcodes are 1 ... BIN_MAX_OPCODE-1
+
+// Binary opcodes
+#define OP_SERVO         0x10     // servo <id:b> <pwm:h>
+#define OP_SETPOINT      0x11     // setpoint <centidegrees:h> x POSE_SERVOS
+#define OP_BEGIN         0x12     // begin (a servo batch)
+#define OP_END           0x13     // end (send the batch)
+#define OP_WAIT          0x14     // wait <ms:h>
+#define OP_ANGLE         0x15     // angle <id:b> <centidegrees:h>
+#define OP_TILT          0x16     // tilt <centidegrees:h>
+#define OP_NOD           0x17     // nod <centidegrees:h>
+#define OP_POSE          0x18     // pose <tilt centidegrees:h> <nod centidegrees:h>
+
+// Binary reply status codes
+#define BIN_OK           0x00
+#define BIN_ERR_CRC      0x01     // bad CRC (or bad COBS encoding)
+#define BIN_ERR_OPCODE   0x02     // no command has this opcode
+#define BIN_ERR_LENGTH   0x03     // wrong number of argument bytes
+#define BIN_ERR_FAILED   0x04     // the command itself failed
+
+/* - - - - -  Argument schema - one entry per argument */
+enum argType_t : uint8_t
+{
+  ARG_INT8,     // integer (1 byte in a binary frame)
+  ARG_INT16,    // integer (2 bytes)
+  ARG_INT32,    // integer (4 bytes)
+  ARG_SERVO,    // servo id - a servo name (or number) in text, 1 byte in binary
+  ARG_CDEG,     // angle in centidegrees - decimal degrees in text ("12.5"), 2 bytes in binary
+  ARG_STR       // string - text commands only
+};
+
+struct argSpec_t
+{
+  argType_t type;
+  int32_t minVal;       // range (integer types only)
+  int32_t maxVal;
+  const char *label;    // for error messages
+};
+
+/* - - - - -  Decoded arguments for a command */
+typedef struct
+{
+  int     argCnt;          // does NOT include the command name
+  int32_t val[MAX_ARGS];   // integer args (val[0] is the first arg)
+  char  **tokens;          // text tokens - ARG_STR arg n is tokens[n+1]. nullptr for binary
+} cmdArgs_t;
+
+typedef void (*cmdFunct_t)(Stream *outstream, int tokCnt, char **tokens);
+typedef bool (*cmdExec_t)(Stream *outstream, const cmdArgs_t *args);
+
+// cmdList_t flags
+#define CMD_SLOW       0x01   // slow (flash, reboot...) - runs on the slow lane
+#define CMD_SLOW_VERB  0x02   // ... only if its first arg is 'save' or 'delete'
+
+/* - - - - -  STRUCTURE of the command list*/
+struct cmdList_t
+{
+  const char *name;
+  const char *descr;
+  int minTokCount;  // Includes cmd name - always 1 or more - never 0.
+  int maxTokCount;  // Includes cmd name - always 1 or more!
+  cmdFunct_t funct; // Token command (nullptr for a schema command)
+  const argSpec_t *argSpec; // Schema - maxTokCount-1 entries (nullptr if no args)
+  cmdExec_t exec;   // Schema command (decoded args)
+  uint8_t opcode;   // Binary opcode (0 if text only)
+  uint8_t flags;    // CMD_xxx flags
+  uint32_t hash;    // cmdHash(name) - filled in by the compiler
+
+  // Token command
+  constexpr cmdList_t(const char *_name, const char *_descr, int _minTokCount, int _maxTokCount,
+                      cmdFunct_t _funct, uint8_t _flags = 0)
+    : name(_name), descr(_descr), minTokCount(_minTokCount), maxTokCount(_maxTokCount),
+      funct(_funct), argSpec(nullptr), exec(nullptr), opcode(0), flags(_flags), hash(cmdHash(_name)) {}
+
+  // Schema command
+  constexpr cmdList_t(const char *_name, const char *_descr, int _minTokCount, int _maxTokCount,
+                      const argSpec_t *_argSpec, cmdExec_t _exec, uint8_t _opcode = 0, uint8_t _flags = 0)
+    : name(_name), descr(_descr), minTokCount(_minTokCount), maxTokCount(_maxTokCount),
+      funct(nullptr), argSpec(_argSpec), exec(_exec), opcode(_opcode), flags(_flags), hash(cmdHash(_name)) {}
+};
+
+/*
+NOTE: Special... 
+    if the command is "COMMENT", then the help command is
+    printed as a 'header' (the entry is not indexed)
+NOTE:
+     LAST entry ** must ** have a minTokCount of 0 - this indicates end-of-list
+*/
+
+class CmdQueue;
+enum jobKind_t : uint8_t;
+struct cmdJob_t;
+
 class Commands {
   
 private:
-  void tokenize();
   void parseAndExecute();
-  void dispatch(int tokCnt, char **tokens);
+  void execute(char *line, bool first);
   char cmdBuf[CMD_BUF_LEN];
+  char *tokens[MAX_ARGS];    // point into cmdBuf - one set per session
   int nxtInBuffer;
   Stream  *thisStream;       // pointer to the I/O stream.
+  ResponseBuf response;      // fast lane commands print here - sent to thisStream when done
+  ResponseBuf slowResponse;  // ... and slow lane commands here
+
+  // Executor (see CmdQueue.h)
+  CmdQueue *fastLane;
+  CmdQueue *slowLane;
+  void queueMarker(jobKind_t kind);
+  static bool isSlow(const cmdList_t *cmd, int tokCnt, char **tokens);
+  void runJob(cmdJob_t *job, ResponseBuf *out);
+  static void fastExecTask(void *param);
+  static void slowExecTask(void *param);
+
+  // Latency timestamps (Stats::now() - see Stats.h)
+  uint32_t chunkStamp;       // when the current chunk of input arrived
+  uint32_t rxStamp;          // ... the first char of this line (or frame)
+  uint32_t eolStamp;         // ... its end
+  void addChar(char ch);
+  void timeCmd(const cmdJob_t *job, uint32_t start, bool ok);
+  static Histogram cmdStats[CMD_STATS_SIZE];  // handler times - one per command
+  static uint8_t statNo[CMD_HASH_SIZE];       // cmdIndex slot -> its cmdStats entry + 1 (0: not timed)
+  static int noOfTimed;
 
+  CobsRx binRx;              // collects a binary frame
+  void recvdBinChar(uint8_t ch);
+  void binDispatch();
+  void binError(uint8_t opcode, uint8_t status);
+  static void binReply(ResponseBuf *out, uint8_t opcode, uint8_t status);
+  static const cmdList_t *opIndex[BIN_MAX_OPCODE];  // binary opcode -> entry
+  static bool checkArg(Stream *outstream, const argSpec_t *spec, long val);
+
+  static const cmdList_t *cmdIndex[CMD_HASH_SIZE];  // open-addressed hash of all entries
+  static const cmdList_t *cmdLists[MAX_CMD_LISTS];  // every list added (for 'help')
+  static int noOfCmdLists;
+  static int noOfIndexed;
+  static thread_local Commands *curSession;  // session running a command on this task
+  static void indexInit();
+  static bool indexCmdList(const cmdList_t *list);
 
 public:
   Commands();   // The initializer
@@ -68,7 +275,17 @@ public:
 
   void begin(Stream *thisIoStream);  // Run time setup, if needed.
 
+  // Add a module's command list to the index. Call at setup time,
+  //   before any session starts processing input.
+  static bool addCmdList(const cmdList_t *list);
+
+  static const cmdList_t *lookup(int tokCnt, char **tokens);
+  static Commands *current();
+  static bool decodeArgs(Stream *outstream, const cmdList_t *cmd, int tokCnt, char **tokens, cmdArgs_t *args);
+  static bool run(Stream *outstream, const cmdList_t *cmd, int tokCnt, char **tokens);
+
   void recvdChar(char ch);
+  bool inBinaryFrame() { return (binRx.active()); }  // true while a binary frame is being collected
   void recvStr(char *ch, int len);
   void flush();
 
@@ -11,11 +11,32 @@
 
 // - - - Settable PREFRENCES - - - - 
 #define FIRMWARE_VERSION "0.0.1"
-#define FLASH_VERSION_NO    3
+#define FLASH_VERSION_NO    8
 #define SSID_DEF         "defnet"
 #define PASS_DEF         "iknowits42"
 #define NAME_DEF         "Skull"
 #define PORTNO_DEF        23
+#define BAUD_DEF          115200
+
+// - - - Serial (USB) command port
+// If defined, the serial port is read from the UART driver's receive
+//   event (in chunks), instead of being polled from loop().
+#define SERIAL_EVENT_DRIVEN
+#define SERIAL_RX_BUF_LEN   1024   // UART driver receive buffer
+#define SERIAL_RX_CHUNK     64     // Receive event fires when this many chars are waiting (or on idle)
+#define SERIAL_MIN_BAUD     9600
+#define SERIAL_MAX_BAUD     5000000
+
+// - - - Command executor (see CmdQueue.h)
+// Each session queues its commands to two executor tasks: the fast
+//   lane runs everything except CMD_SLOW commands (flash writes, 
+//   reboot - and 'macro save|delete', 'wear'), which wait in the slow
+//   lane - at a lower priority. ('wait' holds up the fast lane)
+#define CMD_QUEUE_LEN       8      // jobs per lane (power of 2)
+#define CMD_FAST_PRIO       3
+#define CMD_SLOW_PRIO       1
+#define CMD_EXEC_STACK      4096
+#define CMD_EXEC_CORE       1      // (same core as loop())
 
 // For commands:
 //  if NOT defined, then only 'OK' or 'ERR' are output
@@ -29,71 +50,99 @@
 
 /* - - - - HARDWARE PINS - - - - */
 // I2C... talk to servo driver.
-#define SERVO_I2C_DATA_PIN   GPIO_PIN_21
-#define SERVO_I2C_CLOCK_PIN  GPIO_PIN_22
+#define SERVO_I2C_DATA_PIN   GPIO_NUM_21
+#define SERVO_I2C_CLOCK_PIN  GPIO_NUM_22
 
 // Sound (I2S) output
-#define SOUND_CLK_PIN    GPIO_PIN_25
-#define SOUND_DATA_PIN   GPIO_PIN_26
-#define SOUND_WS_PIN     GPIO_PIN_27
+#define SOUND_CLK_PIN    GPIO_NUM_25
+#define SOUND_DATA_PIN   GPIO_NUM_26
+#define SOUND_WS_PIN     GPIO_NUM_27
 
 
 // SPI (for SD card)
-#define SDI_CS_PIN       GPIO_PIN_5
-#define SDI_MOSI_PIN     GPIO_PIN_23
-#define SDI_CLK_PIN      GPIO_PIN_18
-#define SDI_MISO_PIN     GPIO_PIN_19
-
+#define SDI_CS_PIN       GPIO_NUM_5
+#define SDI_MOSI_PIN     GPIO_NUM_23
+#define SDI_CLK_PIN      GPIO_NUM_18
+#define SDI_MISO_PIN     GPIO_NUM_19
+
+
+// Servo I2C bus (see I2cBus.h). The PCA9685 runs at up to 1 MHz
+//   (Fast-mode Plus) - that needs stiff pull-ups (~1K) on a short bus.
+#define SERVO_I2C_CLOCK        1000000
+#define I2C_QUEUE_LEN          8      // transfers waiting for the bus
+#define I2C_MAX_XFER           (1 + 4 * CHANNELS_PER_BOARD)   // bytes - a whole board
+#define I2C_RETRIES            2      // after the first try
+#define I2C_TIMEOUT_MS         5
+#define I2C_TASK_PRIO          6
+#define I2C_TASK_STACK         3072
+#define I2C_TASK_CORE          1
+
+// ESP32 LEDC pwm backend (see LedcBackend.h - and ledcPins[] in ServoList.h)
+#define LEDC_RES_BITS          16     // at 50 Hz (up to ~1.2 KHz at 16 bits)
+#define LEDC_FADE_MS           0      // fade to each new value over this long (0: step) - keep it under one frame
+
+// If defined, the pulses of each board's servos are spread evenly 
+//   across the pwm period, instead of all starting at count 0 - so 
+//   their current draw doesn't all hit the supply at once.
+#define PWM_STAGGER
 
 // PWM Frequency (Servos usually like 50 hz)
+//   Each board's rate is in Prefs ('refresh'). Pwm limits are always
+//   in counts of a SERVO_PWM_FREQ period - see Servos.h (REFRESH)
 #define SERVO_PWM_FREQ         50
+#define SERVO_MIN_FREQ         24      // (the PCA9685's range)
+#define SERVO_MAX_FREQ         1500
+
+// Servo frame task (sends the changed channels once per PWM frame)
+#define SERVO_FRAME_PRIO       5
+#define SERVO_FRAME_STACK      3072
+#define SERVO_FRAME_CORE       1
 
-// These are the port numbers on the HW-170.
-// They correspond DIRECTLY to the ID parameter
-//    in the Servos clas, and the index to
-//    the servoList[] array.
-#define RIGHT_SERVO       0
-#define LEFT_SERVO        1
-#define ROT_SERVO         2
-#define JAW_SERVO         3
-#define LEYE_SERVO        4
-#define REYE_SERVO        5
-#define NO_OF_SERVOS      6
+// The servos (and their boards) are listed in ServoList.h
+#include "ServoList.h"
 
 // Convert Servo number to a name (for output messages)
 extern String ServoToName(int id);
 
-// Default Limits (Based on HS-317 servo)
-// Note: _MIN and _MAX are servo settings range 0..4095
-// Note: _ANGMIN and _ANGMAX are angles +- 180
-#define DEF_JAW_MIN          500
-#define DEF_JAW_MAX         2600
-#define DEF_JAW_ANGMIN         0
-#define DEF_JAW_ANGMAX        90
-
-#define DEF_ROT_MIN          500
-#define DEF_ROT_MAX         2600
-#define DEF_ROT_ANGMIN        -90
-#define DEF_ROT_ANGMAX         90
-
-#define DEF_LEFT_MIN         500
-#define DEF_LEFT_MAX        2600
-#define DEF_LEFT_ANGMIN       -45
-#define DEF_LEFT_ANGMAX        45
-
-#define DEF_RIGHT_MIN         500
-#define DEF_RIGHT_MAX        2600
-#define DEF_RIGHT_ANGMIN      -45
-#define DEF_RIGHT_ANGMAX       45
-
-#define DEF_LEYE_MIN         500
-#define DEF_LEYE_MAX        2600
-#define DEF_LEYE_ANGMIN      -20
-#define DEF_LEYE_ANGMAX       20
-
-#define DEF_REYE_MIN         500
-#define DEF_REYE_MAX        2600
-#define DEF_REYE_ANGMIN      -20
-#define DEF_REYE_ANGMAX       20
+// Default jerk limit, all servos (degrees/sec/sec/sec) 
+//   0 = trapezoid motion profile, else S-curve (see Servos.h - PROFILES)
+#define DEF_JERK               0
+
+// Default idle time, all servos (seconds) - a servo that hasn't moved
+//   for this long has its channel turned off (0 = never). See Servos.h - IDLE
+#define DEF_IDLE_SECS          60
+
+// Servo current budget (see Servos.h - CURRENT). The default budget 
+//   (mA, all servos - 0 = no limit) is in Prefs ('budget' command).
+//   A move may be slowed to 1/THROTTLE_MAX_STRETCH of its speed, and
+//   a move that hasn't started may wait up to THROTTLE_MAX_DELAY_MS.
+//   A move with no profile is assumed to run at SERVO_JUMP_DPS.
+#define DEF_CURRENT_BUDGET_MA  1500
+#define THROTTLE_MAX_STRETCH   3
+#define THROTTLE_MAX_DELAY_MS  200
+#define SERVO_JUMP_DPS         300
+
+// Servo wear counters (see Servos.h - WEAR) are saved to flash this
+//   often - only the servos whose counters changed.
+#define WEAR_SAVE_SECS         1800
+
+// Default deadband (pwm counts) - a change this small is not sent
+#define DEF_DEADBAND           1
+
+// Head linkage geometry defaults (mm - see Kinematics.h), and the
+//   range (degrees) and step of the tilt x nod pose table
+#define NOD_BASE_DEF           40     // pivot to the LEFT-RIGHT line
+#define TILT_BASE_DEF          30     // 1/2 of LEFT to RIGHT
+#define ARM_LEN_DEF            35     // servo arm
+#define KIN_TILT_MAX           20
+#define KIN_NOD_MAX            30
+#define KIN_STEP_DEG           2
+
+// Calibration: up to this many extra (angle, pwm) points per servo,
+//   between its min and max. The angle->pwm table covers every whole
+//   degree from SERVO_LUT_MIN_ANGLE to SERVO_LUT_MAX_ANGLE.
+#define CAL_MAX_POINTS         6
+#define SERVO_LUT_MIN_ANGLE   -180
+#define SERVO_LUT_MAX_ANGLE    180
 
 #endif
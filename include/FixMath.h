@@ -0,0 +1,66 @@
+/**
+ * @file FixMath.h
+ * @author Doug Fajardo
+ * @brief  Integer math for the servo code - no floating point
+ * @version 0.1
+ * @date 2024-09-20
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Plain C++ - no Arduino - so it can be tested on the host
+ * (test/test_fixmath: pio test -e native).
+ */
+#ifndef F_I_X_M_A_T_H__H
+#define F_I_X_M_A_T_H__H
+#include <stdint.h>
+
+/**
+ * @brief Integer square root (floor)
+ */
+static inline uint32_t isqrt(uint64_t val)
+{
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > val)
+        bit >>= 2;
+    while (bit != 0)
+    {
+        if (val >= res + bit)
+        {
+            val -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+            res >>= 1;
+        bit >>= 2;
+    }
+    return ((uint32_t)res);
+}
+
+
+/**
+ * @brief Divide, rounding to the nearest (halves away from zero)
+ */
+static inline int64_t divRound(int64_t num, int64_t den)
+{
+    return ((num + ((num < 0) ? -den / 2 : den / 2)) / den);
+}
+
+
+/**
+ * @brief Bilinear interpolation within one square cell of a table.
+ *   c00 is the value at (0,0), c10 at (span,0), c01 at (0,span) and
+ *   c11 at (span,span). 'x' and 'y' are where we are in the cell
+ *   (0...span).
+ */
+static inline int32_t bilerp(int32_t c00, int32_t c10, int32_t c01, int32_t c11,
+                             int32_t x, int32_t y, int32_t span)
+{
+    int64_t sum = (int64_t)(span - x) * (span - y) * c00
+                + (int64_t)x * (span - y) * c10
+                + (int64_t)(span - x) * y * c01
+                + (int64_t)x * y * c11;
+    return ((int32_t)divRound(sum, (int64_t)span * span));
+}
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * @file I2cBus.h
+ * @author Doug Fajardo
+ * @brief  Queued (non-blocking) I2C writes for the servo boards
+ * @version 0.1
+ * @date 2024-09-25
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * submit() copies a write into a queue and returns at once. The bus
+ * task sends it with the ESP-IDF I2C command-link API (on the same
+ * port - and driver - as Wire, which serializes the two), and then
+ * calls the transfer's 'done' function, on the bus task, with the
+ * result. So the servo frame task never waits for the bus.
+ *
+ * A NACK is retried (up to I2C_RETRIES times). A timeout means the bus
+ * is stuck (usually a slave holding SDA low after a glitch): the bus
+ * is recovered - up to 9 clocks on SCL, then a STOP - and the write
+ * is retried. NACKs, timeouts, retries, failures and recoveries are
+ * counted (see the 'stats' command).
+ */
+#ifndef I_2_C_B_U_S__H
+#define I_2_C_B_U_S__H
+#include "Config.h"
+#include "freertos/queue.h"
+
+struct i2cXfer_t;
+typedef void (*i2cDone_t)(const i2cXfer_t *xfer, bool ok);
+
+struct i2cXfer_t
+{
+  uint8_t addr;                 // 7 bit address
+  uint8_t len;                  // bytes in data[]
+  uint8_t data[I2C_MAX_XFER];
+  i2cDone_t done;               // called on the bus task when finished (may be nullptr)
+  uint32_t tag;                 // for the caller
+  uint32_t stamp;               // for the caller
+  uint32_t queued;              // Stats::now() when submitted
+};
+
+class I2cBus
+{
+private:
+  typedef struct
+  {
+    uint32_t xfers;       // transfers sent OK
+    uint32_t bytes;
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t retries;
+    uint32_t failed;      // gave up (after the retries)
+    uint32_t recoveries;  // bus clears
+    uint32_t overruns;    // queue full - not sent
+  } i2cStats_t;
+
+  static QueueHandle_t queue;
+  static TaskHandle_t busTask;
+  static uint32_t clockHz;
+  static i2cStats_t counts;
+  static portMUX_TYPE countMux;
+
+  static void busLoop(void *param);
+  static int transfer(const i2cXfer_t *xfer);
+  static void recover();
+
+public:
+  static void begin(uint32_t clock);
+  static bool submit(i2cXfer_t *xfer);
+  static void printStats(Stream *outStream);
+  static void resetStats();
+};
+
+#endif
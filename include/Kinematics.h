@@ -10,44 +10,90 @@
  * This generates servo motion commands from
  * the desired 'pose'.
  * 
- * * Rotate and Jaw are passed straight thru
+ * * Rotate and Jaw are passed straight thru (in degrees, or 
+ *   centidegrees - see Servos.h)
  * * Commands to direct the eyes a given direction (and intensity)
  * * Tilt and Nod operations
+ *
+ * TILT and NOD:
+ *   The head plate pivots at its center. The LEFT and RIGHT servo arms
+ *   push it up at two points NOD_BASE in front of the pivot, TILT_BASE
+ *   either side of center (Prefs - 'geometry' command, mm). Tilting
+ *   the plate (about the front-back axis) by t, then nodding it (about
+ *   the left-right axis) by n, lifts those points by
+ *       z = NOD_BASE*sin(n) +/- TILT_BASE*sin(t)*cos(n)
+ *   (+ for RIGHT), and an arm of ARM_LEN lifts its point by 
+ *   ARM_LEN*sin(angle) - so each servo's angle is asin(z / ARM_LEN)
+ *   (clamped at +/- 90 if the arm can't reach).
+ *
+ *   That is solved once for every KIN_STEP_DEG of tilt x nod, into a
+ *   table (at startup, and whenever the geometry changes). A pose is
+ *   then answered by bilinear interpolation between the 4 nearest 
+ *   entries - integer math, no trig. LEFT and RIGHT are sent in one
+ *   servo batch, so they move in the same frame.
  */
 #ifndef K_I_N_E_M_A_T_I_C_S___H
 #define K_I_N_E_M_A_T_I_C_S___H
 #include "Config.h"
+#include "Servos.h"
+
+#define KIN_TILT_STEPS  (2 * KIN_TILT_MAX / KIN_STEP_DEG + 1)
+#define KIN_NOD_STEPS   (2 * KIN_NOD_MAX / KIN_STEP_DEG + 1)
 
 class Kinematics
 {
+    private:
+        typedef struct
+        {
+            int16_t right;    // servo angles (centidegrees)
+            int16_t left;
+        } kinEntry_t;
+
+        static kinEntry_t table[KIN_TILT_STEPS][KIN_NOD_STEPS];
+        static int builtGeometry[3];      // nod base, tilt base, arm length the table is for
+        static bool tableBuilt;
+        static SemaphoreHandle_t kinLock; // serializes the table and the current pose
+        static cdeg_t curTilt;
+        static cdeg_t curNod;
+
+        static void refreshTable();
+        static void buildTable(int nodBase, int tiltBase, int armLen);
+        static void lookup(cdeg_t tilt, cdeg_t nod, cdeg_t *right, cdeg_t *left);
 
     public:
         Kinematics();
         ~Kinematics();
+        static void begin();
         
         // Internal function calls
-        void rot(int angle);
-        void jaw(int angle);
+        static void rot(int angle);
+        static void jaw(int angle);
+        static void rotCd(cdeg_t angle);
+        static void jawCd(cdeg_t angle);
 
-        void leye( int bright);
-        void reye( int bright);
-        void eyes( int directAngle,   int bright);
-        void getEyes(int *direction,  int *bright);
+        static void leye( int bright);
+        static void reye( int bright);
+        static void eyes( int directAngle,   int bright);
+        static void getEyes(int *direction,  int *bright);
 
-        void pose(int tilt_angle, int nod_angle);
-        void tilt(int angle);
-        void nod(int angle);
+        static void pose(int tilt_angle, int nod_angle);
+        static void tilt(int angle);
+        static void nod(int angle);
+        static void poseCd(cdeg_t tilt_angle, cdeg_t nod_angle);
+        static void tiltCd(cdeg_t angle);
+        static void nodCd(cdeg_t angle);
 
 
         // Command inputs (front end for internal function calls)
-        void rot_cmd(Stream *outstream, int tokCnt, char **tokens);
-        void jaw_cmd(Stream *outstream, int tokCnt, char **tokens);
-        void leye_cmd(Stream *outstream, int tokCnt, char **tokens);
-        void reye_cmd(Stream *outstream, int tokCnt, char **tokens);
-        void eyes_cmd(Stream *outstream, int tokCnt, char **tokens);
-
-        void tilt_cmd(Stream *outstream, int tokCnt, char **tokens);
-        void nod_cmd(Stream *outstream, int tokCnt, char **tokens);
-        void pose_cmd(Stream *outstream, int tokCnt, char **tokens);
+        static void rot_cmd(Stream *outstream, int tokCnt, char **tokens);
+        static void jaw_cmd(Stream *outstream, int tokCnt, char **tokens);
+        static void leye_cmd(Stream *outstream, int tokCnt, char **tokens);
+        static void reye_cmd(Stream *outstream, int tokCnt, char **tokens);
+        static void eyes_cmd(Stream *outstream, int tokCnt, char **tokens);
+
+        static bool tiltExec(Stream *outstream, const cmdArgs_t *args);
+        static bool nodExec(Stream *outstream, const cmdArgs_t *args);
+        static bool poseExec(Stream *outstream, const cmdArgs_t *args);
+        static bool geometryExec(Stream *outstream, const cmdArgs_t *args);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+/**
+ * @file LedcBackend.h
+ * @author Doug Fajardo
+ * @brief  PWM backend: the ESP32's own LEDC channels, on GPIO pins
+ * @version 0.1
+ * @date 2024-09-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Channel n of the board is LEDC channel n, on pin ledcPins[n]
+ * (ServoList.h - channels without a pin are never touched). Writes
+ * are register writes - no bus, so a burst is finished at once - at
+ * LEDC_RES_BITS of resolution (vs the PCA9685's 12).
+ * If LEDC_FADE_MS is not 0, the hardware fades each channel to its new
+ * value over that time, instead of stepping (for LEDs, mostly - a
+ * 50 Hz servo only sees one pulse per frame anyway).
+ */
+#ifndef L_E_D_C_B_A_C_K_E_N_D__H
+#define L_E_D_C_B_A_C_K_E_N_D__H
+#include "PwmBackend.h"
+#include "driver/ledc.h"
+
+class LedcBackend : public PwmBackend
+{
+private:
+  uint8_t boardNo;
+  uint32_t freq;
+  static ledc_mode_t chanMode(int chan);
+  static ledc_channel_t chanNo(int chan);
+  uint32_t hpoint(int chan);
+
+public:
+  LedcBackend(int board);
+  void begin(uint32_t freqHz) override;
+  uint32_t periodUs() override;
+  void write(pwmBurst_t *burst, const int *vals) override;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file Macros.h
+ * @author Doug Fajardo
+ * @brief  Record, save and replay sequences of commands.
+ * @version 0.1
+ * @date 2024-09-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ *   macro record <name>  - following lines (from this session) are
+ *                          recorded, NOT executed
+ *   macro end            - stop recording
+ *   macro run <name>     - replay it
+ *   macro save <name>    - write it to flash (reloaded at boot)
+ *   macro delete <name>  - forget it (and remove it from flash)
+ *   macro list           - list the macros
+ *   wait <ms>            - pause. In a macro, the pause is timed from
+ *                          the previous wait (not from 'now'), so the
+ *                          timing of a replay doesn't drift.
+ *
+ * Each line is looked up (and its args decoded and checked) ONCE,
+ * when it is recorded. A step for a schema command is stored as its
+ * exec function plus its decoded args - replay is just a call.
+ * Token commands (and schema commands with a string arg) are stored
+ * as text, and only re-tokenized on replay.
+ *
+ * Only one session can record at a time.
+ *
+ * 'macro save' and 'macro delete' write flash, so they run on the slow
+ * lane (see Commands.h). Everything else runs on the fast lane - a 
+ * replay and its waits hold up the session's later commands until 
+ * it is done, just as its steps would if they were typed.
+ *
+ * The slots are shared by every session and both lanes, so they are
+ * only touched under a lock. A replay takes it for each step (not for
+ * the whole replay - its waits would hold up everyone else), so a
+ * macro deleted while it plays stops at its next step.
+ */
+#ifndef M_A_C_R_O_S__H
+#define M_A_C_R_O_S__H
+#include "Config.h"
+#include "Commands.h"
+
+#define MAX_MACROS        8
+#define MACRO_NAME_LEN    12     // including the NUL
+#define MACRO_MAX_STEPS   32
+#define MACRO_TEXT_LEN    512    // source text of all steps in a macro
+
+class Macros
+{
+private:
+  typedef struct
+  {
+    const cmdList_t *cmd;     // the command (looked up when recorded)
+    bool decoded;             // true: run as exec(args). false: re-tokenize the text
+    cmdArgs_t args;           // its decoded args (if decoded)
+    uint16_t textOfs;         // its source line, in text[]
+  } macroStep_t;
+
+  typedef struct
+  {
+    char name[MACRO_NAME_LEN];  // "" if this slot is free
+    bool complete;              // false while recording
+    uint32_t gen;               // changes each time the slot is cleared
+    int noOfSteps;
+    macroStep_t steps[MACRO_MAX_STEPS];
+    uint16_t textLen;
+    char text[MACRO_TEXT_LEN];  // source lines, each NUL terminated
+  } macro_t;
+
+  static macro_t macros[MAX_MACROS];
+  static Commands *recorder;    // session that is recording (nullptr if none)
+  static int recSlot;           // ... and the slot it is recording into
+  static const cmdList_t cmdList[];
+  static SemaphoreHandle_t macroLock;
+  static void lock();
+  static void unlock();
+
+  static int find(const char *name);
+  static int findFree();
+  static void clear(int slot, const char *name);
+  static bool addStep(Stream *outStream, macro_t *mac, int tokCnt, char **tokens);
+  static void load(int slot);
+  static bool save(int slot);
+  static bool run(Stream *outStream, const char *name);
+  static bool edit(Stream *outStream, const char *op, const char *name);
+
+public:
+  static void begin();   // call after every module has added its commands
+
+  static bool isRecording(Commands *session) { return ((recorder != nullptr) && (recorder == session)); }
+  static void record(Stream *outStream, int tokCnt, char **tokens);
+
+  static void macroCmd(Stream *outStream, int tokCnt, char **tokens);
+  static bool waitExec(Stream *outStream, const cmdArgs_t *args);
+};
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file NameHash.h
+ * @author Doug Fajardo
+ * @brief  Compile-time name hash (command names, servo names)
+ * @version 0.1
+ * @date 2024-09-24
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef N_A_M_E_H_A_S_H__H
+#define N_A_M_E_H_A_S_H__H
+#include <stdint.h>
+
+// FNV-1a hash of a name, folded to lower case.
+//   (constexpr - so the table entries are hashed by the compiler)
+#define CMD_HASH_SEED   2166136261u
+#define CMD_HASH_PRIME  16777619u
+constexpr uint32_t cmdHash(const char *str, uint32_t hash = CMD_HASH_SEED)
+{
+  return ((*str == '\0') ? hash :
+    cmdHash(str + 1, (hash ^ (uint32_t)(uint8_t)(((*str >= 'A') && (*str <= 'Z')) ? (*str + ('a' - 'A')) : *str)) * CMD_HASH_PRIME));
+}
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file Pca9685Backend.h
+ * @author Doug Fajardo
+ * @brief  PWM backend: an HW716 (PCA9685) board on the I2C bus
+ * @version 0.1
+ * @date 2024-09-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * The board is run with register auto-increment on, so any run of
+ * channels is ONE I2C write: the start register, then 4 bytes per
+ * channel. Writes are queued to the I2C bus task (I2cBus.h), so
+ * write() never waits - the burst is finished on the bus task.
+ */
+#ifndef P_C_A_9_6_8_5_B_A_C_K_E_N_D__H
+#define P_C_A_9_6_8_5_B_A_C_K_E_N_D__H
+#include "PwmBackend.h"
+#include "I2cBus.h"
+#include <Adafruit_PWMServoDriver.h>
+
+class Pca9685Backend : public PwmBackend
+{
+private:
+  Adafruit_PWMServoDriver driver;
+  uint8_t boardNo;
+  uint8_t addr;
+  static void xferDone(const i2cXfer_t *xfer, bool ok);
+
+public:
+  Pca9685Backend(int board, uint8_t i2cAddr);
+  void begin(uint32_t freqHz) override;
+  uint32_t periodUs() override;
+  void write(pwmBurst_t *burst, const int *vals) override;
+};
+
+#endif
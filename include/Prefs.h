@@ -7,6 +7,7 @@
 
 #ifndef P_R_E_F_S__H
 #define P_R_E_F_S__H
+#include "Commands.h"
 
 class Prefs
 {
@@ -14,6 +15,13 @@ class Prefs
     static Preferences *preferences;
     static bool alreadyInited;
 
+    // The settings are set on a session's fast lane, and committed on
+    //   its slow lane (see Commands.h), so every setter, and commit(),
+    //   holds this lock. Flash is written without it.
+    static SemaphoreHandle_t prefLock;
+    static void lock();
+    static void unlock();
+
     // network settings
     static int versionNo;
     static bool versionChanged;
@@ -25,26 +33,60 @@ class Prefs
     static bool name_changed;
     static uint32_t  pref_portno;
     static bool portno_changed;
+    static uint32_t  pref_baud;
+    static bool baud_changed;
+    static uint32_t  pref_budget;
+    static bool budget_changed;
+
+    // Head linkage geometry (mm - see Kinematics.h)
+    typedef struct
+    {
+      int nodBase;
+      int tiltBase;
+      int armLen;
+    } geometry_t;
+    static geometry_t pref_geometry;
+    static bool geometry_changed;
 
   public:
+    typedef struct
+    {
+      int16_t angle;
+      int16_t pwm;
+    } calPoint_t;
+
     typedef struct
     {
       int minimum;   // shortest allowed pwm on time (uSecs)
       int minAngle;  // angle corresponding to minimum
       int maximum;   // longest allowed pwm on time (uSecs)
       int maxAngle;  // angle corresponding to max
+      int deadband;  // pwm changes this small (or smaller) are not sent
+      int maxVel;    // degrees/sec (0: no motion profile - move at once)
+      int maxAccel;  // degrees/sec/sec (0: no limit)
+      int maxJerk;   // degrees/sec/sec/sec (0: trapezoid profile)
+      int idleSecs;  // turn the channel off after this long with no moves (0: never)
+      int calCount;  // number of calibration points (between min and max)
+      calPoint_t cal[CAL_MAX_POINTS];  // ... sorted by angle
       bool limits_changed; // flag -true if any limit or angle changed
     } ServoLimits_t;
 
   private:
     // Min/Max on time for all servos
     static ServoLimits_t servoLimits[NO_OF_SERVOS];
+    static uint32_t limitsVersion;   // bumped whenever any servo's pwm curve changes
+
+    // Pwm refresh rate of each board (Hz)
+    static uint16_t boardRefresh[NO_OF_BOARDS];
+    static bool refresh_changed;
 
     static void readAllValues(bool forceFlag);
+    static bool takeChange(bool *changed, const void *pref, void *copy, size_t len);
+    static bool takeChange(bool *changed, const String *pref, String *copy);
     static String getAString(const char *key);
     static int getANumber(const char *key);
     static void AllPrefsToDefault();
-    static void pad(Stream *outStream, String s, int width);
+    static const cmdList_t cmdList[];
 
   public:
     Prefs();   // dont call intializer - call 'setup' instead!
@@ -57,10 +99,11 @@ class Prefs
     static void reset_flash_cmd(Stream *outstream, int tokCnt, char **tokens);
     static void commit_cmd(Stream *outstream, int tokCnt, char **tokens);
 
-    static void pref_ssid_cmd  (Stream *outstream, int tokCnt, char **tokens);
-    static void pref_pass_cmd  (Stream *outstream, int tokCnt, char **tokens);
-    static void pref_alexa_cmd (Stream *outstream, int tokCnt, char **tokens);
-    static void prefUdpPort_cmd(Stream *outstream, int tokCnt, char **tokens);
+    static bool pref_ssid_exec  (Stream *outstream, const cmdArgs_t *args);
+    static bool pref_pass_exec  (Stream *outstream, const cmdArgs_t *args);
+    static bool pref_alexa_exec (Stream *outstream, const cmdArgs_t *args);
+    static bool prefUdpPort_exec(Stream *outstream, const cmdArgs_t *args);
+    static bool prefBaud_exec   (Stream *outstream, const cmdArgs_t *args);
     
 
     static void wifiSSID(String str);
@@ -75,11 +118,42 @@ class Prefs
     static void udpPort(uint32_t portno);
     static uint16_t  udpPort();
 
+    static void serialBaud(uint32_t baud);
+    static uint32_t serialBaud();
+
+    static void currentBudget(uint32_t milliAmps);
+    static uint32_t currentBudget();
+
+    static void headGeometry(int nodBase, int tiltBase, int armLen);
+    static void headGeometry(int *nodBase, int *tiltBase, int *armLen);
+
     static bool setServoPWM(int id, int min, int max);
     static bool getServoPWM(int id, int *min, int *max);
     
+    // Macros are written to flash at once (NOT on commit)
+    static bool putMacro(int slot, const void *data, size_t len);
+    static size_t getMacro(int slot, void *data, size_t maxLen);
+    static void removeMacro(int slot);
+
+    // Servo wear counters are written to flash at once, too (by Servos - periodically)
+    static bool putWear(int id, const void *data, size_t len);
+    static size_t getWear(int id, void *data, size_t maxLen);
+
     static bool setServoAngles(int id, int minAngle, int maxAngle);
     static bool getServoAngles(int id,  int *minAngle, int *maxAngle);
+    static bool setServoDeadband(int id, int deadband);
+    static int getServoDeadband(int id);
+    static bool setServoMotion(int id, int maxVel, int maxAccel, int maxJerk);
+    static bool getServoMotion(int id, int *maxVel, int *maxAccel, int *maxJerk);
+    static bool setServoIdle(int id, int idleSecs);
+    static int getServoIdle(int id);
+    static bool setServoCalPoint(int id, int angle, int pwm);
+    static bool clearServoCal(int id);
+    static int getServoCal(int id, calPoint_t *points);
+    static uint32_t getLimitsVersion();
+
+    static bool setBoardRefresh(int board, int hz);
+    static int getBoardRefresh(int board);
 
 
 };
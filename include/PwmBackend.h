@@ -0,0 +1,74 @@
+/**
+ * @file PwmBackend.h
+ * @author Doug Fajardo
+ * @brief  A board of PWM channels - where the servo frame task's output goes
+ * @version 0.1
+ * @date 2024-09-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Servos sends each frame's changed channels to the board they are
+ * on, as a run of channels (a 'burst'). Each kind of board is a
+ * backend (servoBoards[] in ServoList.h says which is which):
+ *   Pca9685Backend - an HW716 (PCA9685) on the I2C bus. The default.
+ *   LedcBackend    - the ESP32's own LEDC channels, driving GPIO pins
+ *                    directly: no bus, finer steps, hardware fades.
+ *
+ * Values are pwm on times in 'fine counts': 1/(1<<PWM_FINE_BITS) of a
+ * count, where a count is 1/4096 of the pwm period (the PCA9685's
+ * unit - and the unit of every limit in Prefs). The PCA9685 rounds
+ * them to whole counts, the LEDC uses LEDC_RES_BITS of them.
+ * 0 is full off, PWM_FULL_ON (or more) is full on.
+ *
+ * Each channel's pulse may start part way through the period (its
+ * phase - setPhase()), so the pulses on a board don't all start at
+ * once. A pulse that runs past the end of the period wraps around to
+ * the start: its width is the same.
+ *
+ * A backend may finish a burst later, on another task (the PCA9685
+ * does - see I2cBus.h). Either way, it calls the done function
+ * (setDone()) when the burst is out - or has failed.
+ */
+#ifndef P_W_M_B_A_C_K_E_N_D__H
+#define P_W_M_B_A_C_K_E_N_D__H
+#include "Config.h"
+
+#define PWM_FINE_BITS   4
+#define PWM_FULL_ON     (4095 << PWM_FINE_BITS)
+#define PWM_MAX_PULSE   (4094 << PWM_FINE_BITS)   // longest on time that is still a pulse
+
+struct pwmBurst_t
+{
+  uint8_t board;      // index in servoBoards[]
+  uint8_t first;      // first channel
+  uint8_t last;       // last channel
+  uint32_t stamp;     // for the caller
+  uint32_t queued;    // Stats::now() when written
+};
+typedef void (*pwmDone_t)(const pwmBurst_t *burst, bool ok);
+
+class PwmBackend
+{
+protected:
+  uint16_t phase[CHANNELS_PER_BOARD];   // pulse start, counts (0..4095)
+  static pwmDone_t doneFn;
+  static void finished(const pwmBurst_t *burst, bool ok);
+
+public:
+  PwmBackend();
+  virtual ~PwmBackend() {}
+
+  // Start the board, with its channels at freqHz
+  virtual void begin(uint32_t freqHz) = 0;
+  // The pwm period the board actually runs at (uSecs)
+  virtual uint32_t periodUs() = 0;
+  // Send channels burst->first..last.  vals[] is indexed by channel
+  virtual void write(pwmBurst_t *burst, const int *vals) = 0;
+
+  void setPhase(int chan, uint16_t counts);   // (call before begin())
+
+  static PwmBackend *create(int board);
+  static void setDone(pwmDone_t fn);
+};
+
+#endif
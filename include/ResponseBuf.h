@@ -0,0 +1,55 @@
+/**
+ * @file ResponseBuf.h
+ * @author Doug Fajardo
+ * @brief  A fixed-size buffer for command responses.
+ * @version 0.1
+ * @date 2024-09-10
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ * Command functions print their response (a piece at a time) to a 
+ * Stream. Each session passes them a ResponseBuf instead of its real
+ * I/O stream. Everything printed is collected here, and sent to the
+ * real stream in one write() when the command is done (flush()), or
+ * when the buffer fills up.
+ * 
+ * No heap is used. appendf() formats straight into the buffer.
+ * Command functions only see a Stream, so they print formatted text
+ * with ResponseBuf::printTo() - NOT Stream::printf(), which takes its
+ * buffer from the heap for anything over 64 characters. printTo() 
+ * formats on the stack (RESP_LINE_LEN at most), then write()s.
+ */
+#ifndef R_E_S_P_O_N_S_E_B_U_F__H
+#define R_E_S_P_O_N_S_E_B_U_F__H
+#include "Config.h"
+
+#define RESP_BUF_LEN  256
+#define RESP_LINE_LEN 192     // longest printTo() line (longer is truncated)
+
+class ResponseBuf : public Stream
+{
+private:
+  Stream *target;            // where the response finally goes
+  uint8_t buf[RESP_BUF_LEN];
+  size_t used;
+
+public:
+  ResponseBuf();
+  ~ResponseBuf();
+  void begin(Stream *targetStream);
+
+  size_t write(uint8_t ch);
+  size_t write(const uint8_t *data, size_t len);
+  using Print::write;
+  size_t appendf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  static size_t printTo(Stream *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+  void flush();              // send the buffered response to the target
+  void discard();            // throw the buffered response away
+
+  // Output only - nothing to read
+  int available() { return (0); }
+  int read() { return (-1); }
+  int peek() { return (-1); }
+};
+
+#endif
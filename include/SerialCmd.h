@@ -2,6 +2,11 @@
  * I/O  to/from USB 'Serial' device.
  *
  *(By implementing a child of 'Commands')
+ *
+ * With SERIAL_EVENT_DRIVEN (see Config.h), input is taken from the 
+ * UART driver's receive event (on the driver's event task) in chunks,
+ * and handed to Commands::recvStr() - loop() has nothing to do.
+ * Otherwise, loop() polls for input.
  */
 #include "Config.h"
 #include "Commands.h"
@@ -11,11 +16,18 @@
 
 class SerialCmd : public Commands {
 
+private:
+  static bool echoOn;      // echo input back to the sender?
+  static const cmdList_t cmdList[];
+  void rxChunk();          // read (and process) whatever is waiting
+
 public:
   SerialCmd();
   ~SerialCmd();
   void begin();
-  void loop();   // this collects chars for the command buffer
+  void loop();   // this collects chars for the command buffer (if not event driven)
+
+  static void echoCmd(Stream *outstream, int tokCnt, char **tokens);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file ServoList.h
+ * @author Doug Fajardo
+ * @brief  The servo table - every servo channel, on every board
+ * @version 0.1
+ * @date 2024-09-24
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * A servo's id is its index in servoTable[]. Each entry gives its 
+ * name (for commands - and its flash key, so 12 chars max), the 
+ * board and channel it is wired to, and its default limits.
+ * To add a servo, add a line. To add a board, add it to servoBoards[]
+ * too.
+ *
+ * A board is an HW716 (PCA9685) on the I2C bus - or the ESP32's own 
+ * LEDC channels (see PwmBackend.h), which drive GPIO pins directly. 
+ * To move a servo (say, LEYE) to a GPIO pin: add {PWM_LEDC, 0, 50} to
+ * servoBoards[], give the pin to an LEDC channel in ledcPins[], and
+ * put the servo on that board and channel.
+ *
+ * Each board has its own refresh rate (the default is below - the
+ * 'refresh' command changes it, in Prefs). Analog servos want 50 Hz;
+ * digital ones take 200-333 Hz, and every frame sooner is a frame 
+ * less of latency. So put the fast servos (the jaw, the eyes) on a
+ * board of their own - a second HW716, or the LEDC - and speed it up.
+ * 
+ * The name hash is computed by the compiler (see NameHash.h), so 
+ * looking up a name costs one hash - however many servos there are.
+ */
+#ifndef S_E_R_V_O_L_I_S_T__H
+#define S_E_R_V_O_L_I_S_T__H
+#include "NameHash.h"
+
+enum pwmType_t { PWM_PCA9685, PWM_LEDC };
+
+struct servoBoard_t
+{
+  pwmType_t type;
+  uint8_t addr;       // PCA9685: I2C address  (LEDC: not used)
+  uint16_t freqHz;    // default refresh rate
+};
+
+// The boards. The HW716s are chained on the same I2C bus. 
+//   (Board 0 sets the frame rate - see Servos.h)
+constexpr servoBoard_t servoBoards[] = 
+{
+  {PWM_PCA9685, 0x40, SERVO_PWM_FREQ},
+};
+constexpr int NO_OF_BOARDS = sizeof(servoBoards) / sizeof(servoBoards[0]);
+#define CHANNELS_PER_BOARD   16
+
+// LEDC board: GPIO pin for each LEDC channel (-1: not used)
+constexpr int8_t ledcPins[CHANNELS_PER_BOARD] = 
+{
+  -1, -1, -1, -1, -1, -1, -1, -1,  -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+struct servoDesc_t
+{
+  const char *name;
+  uint8_t board;      // index in servoBoards[]
+  uint8_t channel;    // 0 ... CHANNELS_PER_BOARD-1
+  int16_t minPwm;     // default limits (see Prefs::ServoLimits_t)
+  int16_t maxPwm;
+  int16_t minAngle;
+  int16_t maxAngle;
+  int16_t maxVel;
+  int16_t maxAccel;
+  int16_t holdMa;     // current model (see Servos.h - CURRENT): mA while on
+  int16_t maPerDps;   //   ... plus this many mA per degree/sec of speed
+  uint8_t priority;   // higher: throttled last
+  uint32_t hash;      // cmdHash(name) - filled in by the compiler
+
+  constexpr servoDesc_t(const char *_name, uint8_t _board, uint8_t _channel, int16_t _minPwm, int16_t _maxPwm,
+                        int16_t _minAngle, int16_t _maxAngle, int16_t _maxVel, int16_t _maxAccel,
+                        int16_t _holdMa, int16_t _maPerDps, uint8_t _priority)
+      : name(_name), board(_board), channel(_channel), minPwm(_minPwm), maxPwm(_maxPwm),
+        minAngle(_minAngle), maxAngle(_maxAngle), maxVel(_maxVel), maxAccel(_maxAccel),
+        holdMa(_holdMa), maPerDps(_maPerDps), priority(_priority), hash(cmdHash(_name)) {}
+};
+
+// Default Limits (Based on HS-317 servo)
+//   PWM is the on time, in counts of a SERVO_PWM_FREQ period (1/4096 
+//   of it - 0..4095), whatever rate the servo's board runs at.
+//   Angles are degrees, +- 180.
+//   Motion limits (see Servos.h - PROFILES): max speed (degrees/sec, 
+//   0 = move at once), max acceleration (degrees/sec/sec, 0 = no limit)
+//   Current model (see Servos.h - CURRENT): holding current (mA), 
+//   mA per degree/sec of speed, and priority (higher = throttled last)
+constexpr servoDesc_t servoTable[] =
+{
+  //  name    board chan  minPwm maxPwm  minAng maxAng  deg/s  deg/s/s   hold mA  mA/dps  prio
+  {"RIGHT",     0,   0,    500,  2600,    -45,    45,   120,    600,       20,     2,     1},
+  {"LEFT",      0,   1,    500,  2600,    -45,    45,   120,    600,       20,     2,     1},
+  {"ROT",       0,   2,    500,  2600,    -90,    90,   180,    720,       20,     2,     2},
+  {"JAW",       0,   3,    500,  2600,      0,    90,     0,      0,       20,     2,     3},
+  {"LEYE",      0,   4,    500,  2600,    -20,    20,     0,      0,        5,     1,     0},
+  {"REYE",      0,   5,    500,  2600,    -20,    20,     0,      0,        5,     1,     0},
+};
+constexpr int NO_OF_SERVOS = sizeof(servoTable) / sizeof(servoTable[0]);
+
+// The head servos, by id (their place in servoTable[])
+#define RIGHT_SERVO       0
+#define LEFT_SERVO        1
+#define ROT_SERVO         2
+#define JAW_SERVO         3
+#define LEYE_SERVO        4
+#define REYE_SERVO        5
+
+// 'setpoint' sets the first POSE_SERVOS servos (the head) together
+#define POSE_SERVOS       6
+
+#endif
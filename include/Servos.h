@@ -10,42 +10,316 @@
  *
  * LOGIC:
  *   The servo driver (driven by HW716 chip) is operated at 50 hz.
+ *   The servos, and the boards they are on, are listed in ServoList.h.
+ *   Each board is driven by a PwmBackend (an HW716, or the ESP32's own
+ *   LEDC channels). Servos only sees 'fine' pwm counts - see PwmBackend.h.
  *   POSition limits are defined in the range 0...4096  (int)
  *   ANGLES are limited to 0 +/- 180    (int)
+ *   Positions are carried in centidegrees (cdeg_t) all the way to the
+ *   pwm count - the degree API is a front end for the centidegree one.
+ *   No floating point is used on the way.
+ *
+ * FRAMES:
+ *   Servo writes are NOT sent at once. The latest value for each 
+ *   channel is held until the next PWM frame: a timer, running at the
+ *   HW716's own PWM period, wakes the frame task, which sends every
+ *   channel that changed in ONE burst. A value replaced before its 
+ *   frame is 'coalesced' - it never reaches the bus. So the I2C load
+ *   is at most one burst per frame, however fast commands arrive.
+ *
+ *   A write whose value is the same as the channel's programmed value
+ *   (hwPwm) - or within the servo's deadband (Prefs) of it - is 
+ *   dropped ('suppressed'). That stops +/-1 count churn from noisy 
+ *   inputs reaching the bus (and the servo).
+ *
+ * CALIBRATION:
+ *   Each servo's angle->pwm curve is piecewise linear: from (minAngle,
+ *   min pwm), through any calibration points (Prefs), to (maxAngle,
+ *   max pwm). It is compiled into a table with one entry per degree,
+ *   rebuilt only when the limits change (Prefs::getLimitsVersion()), 
+ *   so converting an angle is a clamp, an array index, and (for a 
+ *   fraction of a degree) a linear step to the next entry.
+ *
+ * PROFILES:
+ *   A servo with a max velocity (Prefs - 'motion' command) does not 
+ *   jump to a new angle: the angle becomes its target, and each frame
+ *   tick moves it one step along a velocity- and acceleration-limited
+ *   (trapezoid) profile. Every tick works from the current position 
+ *   and speed, so a new target mid-move just bends the path.
+ *   If it also has a jerk limit, the trapezoid's position is passed 
+ *   through a moving average (accel/jerk ticks long) - an S-curve: the
+ *   acceleration ramps, and the end point is still exact.
+ *   The reported angle is the profiled position, not the target.
+ *   Profile math is fixed point: centidegrees << PROF_SHIFT, per tick.
+ *
+ * CURRENT:
+ *   Each frame tick, the servos' supply current is predicted from the
+ *   model in ServoList.h: every servo that is on draws its holding 
+ *   current, and every move adds mA per degree/sec of its top speed (a
+ *   move with no profile is taken to run at SERVO_JUMP_DPS, for as 
+ *   long as that takes). If the total is over the budget (Prefs - 
+ *   'budget' command), moves are throttled, lowest priority first:
+ *   first stretched - their speed cap is cut, down to as little as 
+ *   1/THROTTLE_MAX_STRETCH - then, if that isn't enough, a move that
+ *   hasn't started yet is delayed a tick (for THROTTLE_MAX_DELAY_MS at
+ *   most). A move with no profile is never throttled - it is counted,
+ *   so the others make room for it. The end point of a move never 
+ *   changes - it just gets there later. Throttled moves, and the time
+ *   they spent stretched or delayed, are counted (see 'stats').
+ *
+ * IDLE:
+ *   A servo that hasn't been written for its idle time (Prefs - 'idle'
+ *   command) has its channel turned fully off: no pulses, no holding
+ *   torque, no heat. lastPos is kept. The next write to it turns it
+ *   back on in the next frame - a profiled servo starts its move from
+ *   lastPos, so it doesn't jump. Time spent energised (and the number
+ *   of idle turn-offs) is counted per servo.
+ *
+ * WEAR:
+ *   Each servo counts (for maintenance): degrees travelled, direction
+ *   reversals, time held at a limit (a command clamped to minAngle or
+ *   maxAngle - until a command that isn't, or the servo goes idle), 
+ *   and time energised. Each update is a few adds, where lastPos 
+ *   changes. The counters are saved to flash (Prefs - one key per 
+ *   servo) every WEAR_SAVE_SECS, from loop() - and only the servos 
+ *   whose counters changed - so the flash sees a few small writes an
+ *   hour. After a reboot they carry on from the last save.
+ *
+ * BATCHES:
+ *   Between beginBatch() and commitBatch(), servo writes are only 
+ *   staged. commitBatch() queues every staged servo at once, so they 
+ *   all land in the same frame - a whole pose changes together.
+ *   Batches nest, and are global - while any batch is open, ALL
+ *   writes are staged. A servo's position (getServoAngle()) and wear
+ *   counters only change when its staged move is committed.
+ *
+ * BURSTS:
+ *   Each frame, every board is sent its changed channels, as runs of 
+ *   channels ('bursts' - a channel that isn't in the servo table splits
+ *   a burst in two - we never write a channel we don't own). An HW716
+ *   (PCA9685) writes a burst in ONE I2C transaction, queued to the I2C 
+ *   bus task (I2cBus.h) - the frame task never waits on the bus.
+ *   If a burst fails, its channels are marked dirty (and their shadow 
+ *   unknown) so the next frame sends them again.
+ *
+ * REFRESH:
+ *   Each board runs at its own pwm rate (Prefs - 'refresh'). The frame
+ *   timer runs at the fastest board's period; a slower board is sent
+ *   its channels every frameDiv'th frame (its period / the frame's,
+ *   rounded). So a 250 Hz board's servos see a new value within 4 ms, 
+ *   while the 50 Hz board's still get one burst per 20 ms.
+ *   Pwm limits (Prefs) are counts of a SERVO_PWM_FREQ period - an on
+ *   TIME, whatever the rate. Each servo's table is built in fine counts
+ *   of its own board's period, so the conversion costs nothing extra.
+ *   The longest pulse must fit in the period: a 2600 count limit allows
+ *   78 Hz at most, and a 333 Hz board needs limits under 615. 'refresh'
+ *   refuses a rate the limits don't fit (and 'setpwm' a limit the rate
+ *   doesn't).
+ *
+ * STAGGER:
+ *   A servo draws most of its current when its pulse starts. If 
+ *   PWM_STAGGER is defined, the n servos on a board start their pulses
+ *   4096/n counts apart (see staggerPhases()), so the supply sees n 
+ *   small current spikes per frame, not one big one. Widths (and so
+ *   positions) are unchanged - every write gets it, with no extra cost.
  *        
  */
 
 #ifndef S_E_R_V_O_S__H
 #define S_E_R_V_O_S__H
 #include "Config.h"
-#include <Wire.h>
-#include <Adafruit_PWMServoDriver.h>
+#include "Commands.h"
+#include "esp_timer.h"
+#include "Stats.h"
+#include "PwmBackend.h"
+
+// An angle in 1/100ths of a degree
+typedef int32_t cdeg_t;
+#define CDEG_PER_DEG   100
+
+// Motion profile positions are centidegrees << PROF_SHIFT
+#define PROF_SHIFT     8
+// Size of the servo name index (power of 2, at least 2x NO_OF_SERVOS)
+#define SERVO_HASH_SIZE  128
+
+// Longest S-curve smoothing (frame ticks)
+#define PROF_FILTER_MAX  32
 
 class Servos
 {
 private:
-    static Adafruit_PWMServoDriver hw716;
+    static PwmBackend *boards[NO_OF_BOARDS];
+    static int8_t chanMap[NO_OF_BOARDS][CHANNELS_PER_BOARD];  // servo id on each channel (-1: none)
+    static int8_t nameIndex[SERVO_HASH_SIZE];   // servo name hash -> id (-1: empty)
+    typedef struct
+    {
+        int32_t velMax;   // limits, per frame tick (0: no profile)
+        int32_t accMax;
+        int filterLen;    // S-curve moving average length (1: trapezoid)
+        int32_t trapPos;  // where the trapezoid is now
+        int32_t vel;      // ... its speed, per tick
+        int32_t pos;      // profile output (the moving average)
+        int32_t hist[PROF_FILTER_MAX];  // last filterLen trapPos values
+        int64_t histSum;
+        int histIdx;
+        int settle;       // ticks since trapPos reached target
+        cdeg_t target;
+        bool moving;      // true until pos reaches target
+        bool staged;      // true if stagedTarget is waiting for commitBatch()
+        cdeg_t stagedTarget;
+        int32_t velCap;   // this tick's speed limit (velMax - or less, if throttled)
+        bool started;     // false until the move's first step
+        bool held;        // delayed this tick (current budget)
+        int delayTicks;   // ticks this move has been delayed
+        bool throttled;   // this move was throttled (counted once)
+    } profile_t;
+
     typedef struct 
     {
         bool ServoIsDefined;
-        int lastPos;     
+        cdeg_t lastPos;   // centidegrees
+        bool staged;      // true if stagedPwm is waiting for commitBatch()
+        int stagedPwm;
+        bool stagedMove;  // ... and it is a move to stagedPos (not raw pwm)
+        cdeg_t stagedPos;
+        bool stagedAtLimit;  // the staged move (or target) was clamped
+        int pwm;          // latest value for the channel (fine counts)
+        bool dirty;       // true if pwm is waiting for the next frame
+        int hwPwm;        // shadow: what the channel IS programmed to (-1 if unknown)
+        profile_t prof;
+        bool armed;             // channel is driven (false: off - never written, or idle)
+        uint32_t lastActive;    // millis() of the last write
+        uint32_t armedSince;    // millis() when it was turned on
+        uint64_t energisedMs;   // time on - up to armedSince
+        uint32_t idleOffs;      // times turned off for being idle
+        int jumpTicks;          // a move with no profile: ticks it (probably) still takes
+        // wear
+        uint64_t travelCdeg;    // centidegrees travelled
+        uint32_t reversals;     // direction changes
+        int8_t lastDir;         // last direction moved (-1, +1 - 0: none yet)
+        bool atLimit;           // last command was clamped to a limit
+        uint32_t limitSince;    // millis() when it got there
+        uint64_t limitMs;       // time at a limit - up to limitSince
+        bool wearChanged;       // counters changed since the last save
     } servoList_t;
 
-    static int decodeId(const char *str);
+    typedef struct
+    {
+        uint64_t travelCdeg;
+        uint64_t limitMs;
+        uint64_t energisedMs;
+        uint32_t reversals;
+        uint32_t spare;
+    } wear_t;                   // saved form of a servo's wear counters
+
+    typedef struct
+    {
+        uint32_t frames;      // frame ticks
+        uint32_t bursts;      // bursts queued to the I2C bus
+        uint32_t writes;      // servo writes queued
+        uint32_t coalesced;   // ... replaced before their frame
+        uint32_t suppressed;  // ... dropped - unchanged, or inside the deadband
+        uint32_t throttledMoves;  // moves stretched or delayed (current budget)
+        uint32_t stretchTicks;    // servo-ticks spent stretched
+        uint32_t delayTicks;      // servo-ticks spent delayed
+        uint32_t overBudget;      // ticks still over budget (after throttling)
+        uint32_t clipped;         // pulses too long for their board's period
+    } frameStats_t;
+
+    typedef struct
+    {
+        int lowAngle;     // clamp range (degrees)
+        int highAngle;
+        uint16_t pwm[SERVO_LUT_MAX_ANGLE - SERVO_LUT_MIN_ANGLE + 1];  // fine counts - indexed by angle - SERVO_LUT_MIN_ANGLE
+    } servoLut_t;
+
     static servoList_t servoList[NO_OF_SERVOS];
+    static SemaphoreHandle_t hwLock;  // serializes board and servoList access
+    static void lock();
+    static void unlock();
+    static int batchDepth;            // >0 while a batch is open
+    static void writePwm(int id, int pwmVal);
+    static void queuePwm(int id, int pwmVal);
+    static void moveTo(int id, cdeg_t pos);
+    static void startMove(int id, cdeg_t target);
+    static void jumpTo(int id, cdeg_t pos, int pwmVal);
+    static void resetFilter(profile_t *prof);
+    static void stepProfiles();
+    static cdeg_t stepProfile(profile_t *prof);
+    static void checkIdle(int id, uint32_t now);
+    static void trackWear(int id, cdeg_t pos);
+    static void setAtLimit(int id, bool atLimit, uint32_t now);
+    static void getWear(int id, wear_t *wear, uint32_t now);
+    static void loadWear();
+    static void saveWear();
+    static uint32_t lastWearSave;
+    static int8_t prioOrder[NO_OF_SERVOS];    // servo ids, lowest priority first
+    static void scheduleCurrent();
+    static void burstDone(const pwmBurst_t *burst, bool ok);
+    static int anglePwm(int id, cdeg_t pos, cdeg_t *clampedPos);
+    static servoLut_t lut[NO_OF_SERVOS];
+    static uint32_t lutVersion;       // Prefs::getLimitsVersion() the tables were built from
+    static void buildLut(int id);
+    static void loadMotion(int id);
+    static void refreshTables(bool force = false);
+    static int toFine(int id, int counts);
+    static int maxPulse(int board);
+    static void staggerPhases();
+
+    // Frame scheduler
+    static TaskHandle_t frameTask;
+    static esp_timer_handle_t frameTimer;
+    static uint32_t framePeriodUs;
+    static uint16_t boardHz[NO_OF_BOARDS];     // each board's pwm rate
+    static uint8_t frameDiv[NO_OF_BOARDS];     // ... sent every frameDiv'th frame
+    static void frameTick(void *arg);
+    static void frameLoop(void *param);
+    static void flushFrame();
+    static frameStats_t frameStats;
+    static Histogram burstTime;       // each frame burst: written ... out
+    static bool inputPending;         // pendingStamp is valid
+    static uint32_t pendingStamp;     // oldest input waiting for the next frame
+    static thread_local uint32_t inputStamp;  // input the current task is running
+    static const cmdList_t cmdList[];
 
 public:
     Servos();
     ~Servos();
     static void begin();
+    static void loop();
 
+    static int decodeId(const char *str);
     static bool getMinMaxAngles(int id, int *min, int *max);
     static bool setServoAngle(int id, int pos);
     static int getServoAngle(int id);
+    static void setPose(const int *angles, int count = NO_OF_SERVOS);
+    static bool setServoAngleCd(int id, cdeg_t pos);
+    static cdeg_t getServoAngleCd(int id);
+    static void setPoseCd(const cdeg_t *angles, int count = NO_OF_SERVOS);
+
+    static void beginBatch();
+    static bool commitBatch();
+    static void setInputStamp(uint32_t stamp);
+    static void printStats(Stream *outStream);
+    static void resetStats();
+
+    static bool beginExec(Stream *outStream, const cmdArgs_t *args);
+    static bool endExec(Stream *outStream, const cmdArgs_t *args);
 
-    static void ServoSetPwmlimitsCmd(Stream *outStream, int argcnt, char **argList);
-    static void ServoAnglelimitsCmd(Stream *outStream, int argcnt, char **argList);
-    static void ServoPosCmd(Stream *outStream, int argcnt,  char **argList);
+    static bool ServoSetPwmlimitsExec(Stream *outStream, const cmdArgs_t *args);
+    static bool ServoAnglelimitsExec(Stream *outStream, const cmdArgs_t *args);
+    static bool deadbandExec(Stream *outStream, const cmdArgs_t *args);
+    static int maxRefresh(int board);
+    static bool refreshExec(Stream *outStream, const cmdArgs_t *args);
+    static bool idleExec(Stream *outStream, const cmdArgs_t *args);
+    static bool budgetExec(Stream *outStream, const cmdArgs_t *args);
+    static bool wearExec(Stream *outStream, const cmdArgs_t *args);
+    static bool motionExec(Stream *outStream, const cmdArgs_t *args);
+    static bool calPointExec(Stream *outStream, const cmdArgs_t *args);
+    static bool calClearExec(Stream *outStream, const cmdArgs_t *args);
+    static bool ServoPosExec(Stream *outStream, const cmdArgs_t *args);
+    static bool angleExec(Stream *outStream, const cmdArgs_t *args);
+    static bool setpointExec(Stream *outStream, const cmdArgs_t *args);
 };
 
 #endif
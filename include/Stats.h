@@ -0,0 +1,81 @@
+/**
+ * @file Stats.h
+ * @author Doug Fajardo
+ * @brief  Latency counters and log2 histograms.
+ * @version 0.1
+ * @date 2024-09-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Timestamps are microseconds of the system timer (Stats::now() - 
+ * esp_timer_get_time()), which is one clock for both cores. A stage
+ * often starts on one task and ends on another (the serial callback
+ * runs on the UART event task, on either core), so the per-core CPU
+ * cycle counters - which are not in step - can't be used. They wrap
+ * after ~71 minutes, so only intervals are used.
+ *
+ * Each Histogram counts its samples in log2(microseconds) buckets:
+ *   bucket 0 is < 2us, bucket n is 2^n ... 2^(n+1)-1 us, and the last
+ *   bucket holds everything longer.
+ *
+ * Pipeline stages (one histogram each, for all sessions):
+ *    rx-eol    first byte of a line (or frame) received ... end of line
+ *    eol-run   end of line ... handler start (split, tokenize, lookup,
+ *              and the wait in the executor queue)
+ *    handler   handler start ... handler end  (every command)
+ *    in-pwm    first byte received ... the frame burst carrying its
+ *              servo change is on the wire (one sample per burst, 
+ *              timed from the oldest input it carries)
+ *
+ * Per-command histograms (handler time) are kept by Commands, one per
+ * command (up to CMD_STATS_SIZE). Both executor tasks may add to the
+ * same one, so every update is under statMux. See the 'stats' command.
+ */
+#ifndef S_T_A_T_S__H
+#define S_T_A_T_S__H
+#include "Config.h"
+#include "esp_timer.h"
+
+#define STATS_BUCKETS   16       // last bucket is >= 32 ms
+
+class Histogram
+{
+public:
+  uint32_t count;
+  uint32_t errors;       // samples that failed (a command returned ERR)
+  uint32_t maxUs;
+  uint32_t totalUs;
+  uint32_t bucket[STATS_BUCKETS];
+
+  void add(uint32_t us, bool ok);
+  void reset();
+  void print(Stream *outStream, const char *label);
+};
+
+enum statStage_t
+{
+  STAGE_RX_EOL,
+  STAGE_EOL_RUN,
+  STAGE_HANDLER,
+  STAGE_IN_PWM,
+  NO_OF_STAGES
+};
+
+class Stats
+{
+private:
+  static Histogram stages[NO_OF_STAGES];
+
+public:
+  static portMUX_TYPE statMux;   // guards every Histogram update
+  static void begin();
+
+  static inline uint32_t now() { return ((uint32_t)esp_timer_get_time()); }
+
+  static void add(Histogram *hist, uint32_t startUs, uint32_t endUs, bool ok);
+  static void stage(statStage_t stage, uint32_t startUs, uint32_t endUs);
+  static void printStages(Stream *outStream);
+  static void resetStages();
+};
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * @file Tokenizer.h
+ * @author Doug Fajardo
+ * @brief  Split command lines into tokens, in place
+ * @version 0.1
+ * @date 2024-09-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * A line may hold several commands (splitLine()), each of which is
+ * split into tokens (tokenize()). decodeCdeg() reads an angle token.
+ * Plain C++ - no Arduino - so it can be tested on the host
+ * (test/test_tokenizer: pio test -e native).
+ */
+#ifndef T_O_K_E_N_I_Z_E_R__H
+#define T_O_K_E_N_I_Z_E_R__H
+
+// What separates the tokens in a command?
+#define SEPARATOR " ,"
+// A token that starts with one of these runs to the matching quote
+//   (so it may contain separators). The quotes are not part of the token.
+#define QUOTES "\"'"
+// Several commands may share a line, separated by this. The whole line
+//   is one servo batch (see Servos::beginBatch)
+#define CMD_SEPARATOR ';'
+
+class Tokenizer
+{
+public:
+  // Split a line into tokens, in place (reentrant - no static state).
+  static int tokenize(char *line, char **tokens, int maxTokens);
+  // Split a line into commands (at CMD_SEPARATOR), in place
+  static int splitLine(char *line, char **cmds, int maxCmds);
+  // Decimal degrees ("-12.5") to centidegrees - no floating point
+  static bool decodeCdeg(const char *token, long *val);
+};
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file CmdQueue.cpp
+ * @author Doug Fajardo
+ * @brief  Lock-free job queue between a session's input and its executor.
+ * @version 0.1
+ * @date 2024-09-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Config.h"
+#include "CmdQueue.h"
+
+static_assert((CMD_QUEUE_LEN & (CMD_QUEUE_LEN - 1)) == 0, "CMD_QUEUE_LEN must be a power of 2");
+
+
+CmdQueue::CmdQueue()
+{
+  head = 0;
+  tail = 0;
+  consumer = nullptr;
+}
+
+
+/**
+ * @brief Run time setup
+ *
+ * @param consumerTask - the task that runs the jobs (it is notified
+ *                       when a job is published)
+ */
+void CmdQueue::begin(TaskHandle_t consumerTask)
+{
+  consumer = consumerTask;
+}
+
+
+/**
+ * @brief PRODUCER: get the next empty job. Waits while the ring is full.
+ *   Fill it in, then publish() it.
+ *
+ * @return cmdJob_t*
+ */
+cmdJob_t *CmdQueue::claim()
+{
+  uint32_t slot = head.load(std::memory_order_relaxed);
+  while (slot - tail.load(std::memory_order_acquire) >= CMD_QUEUE_LEN)
+    vTaskDelay(1);
+  return (&jobs[slot & (CMD_QUEUE_LEN - 1)]);
+}
+
+
+/**
+ * @brief PRODUCER: hand the claimed job to the consumer
+ */
+void CmdQueue::publish()
+{
+  head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  if (consumer != nullptr)
+    xTaskNotifyGive(consumer);
+}
+
+
+/**
+ * @brief CONSUMER: get the next job. Blocks until there is one.
+ *   Call release() when it is done.
+ *
+ * @return cmdJob_t*
+ */
+cmdJob_t *CmdQueue::next()
+{
+  uint32_t slot = tail.load(std::memory_order_relaxed);
+  while (head.load(std::memory_order_acquire) == slot)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  return (&jobs[slot & (CMD_QUEUE_LEN - 1)]);
+}
+
+
+/**
+ * @brief CONSUMER: done with the job from next() - its slot may be reused
+ */
+void CmdQueue::release()
+{
+  tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+/**
+ * @brief How many jobs have been published so far. A fence for 
+ *   waitDone() - call it from the producer.
+ */
+uint32_t CmdQueue::queued()
+{
+  return (head.load(std::memory_order_relaxed));
+}
+
+
+/**
+ * @brief Wait until the consumer has released every job up to a fence
+ *   (from queued()). Any task may call this - not the consumer.
+ *
+ * @param fence - from queued()
+ */
+void CmdQueue::waitDone(uint32_t fence)
+{
+  while ((int32_t)(tail.load(std::memory_order_acquire) - fence) < 0)
+    vTaskDelay(1);
+}
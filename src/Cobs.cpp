@@ -0,0 +1,165 @@
+/**
+ * @file Cobs.cpp
+ * @author Doug Fajardo
+ * @brief  COBS framing and CRC-16 for binary command frames
+ * @version 0.1
+ * @date 2024-09-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Cobs.h"
+
+
+/**
+ * @brief COBS decode a buffer, in place.
+ * 
+ * @param buf  - the encoded data (no 0x00 delimiters). Overwritten with the decoded data.
+ * @param len  - length of the encoded data
+ * @return int - length of the decoded data, -1 if the encoding is bad.
+ */
+int Cobs::decode(uint8_t *buf, int len)
+{
+  int in = 0;
+  int out = 0;
+  while (in < len)
+  {
+    uint8_t code = buf[in++];
+    if (code == 0)
+      return (-1);
+    for (int idx = 1; idx < code; idx++)
+    {
+      if (in >= len)
+        return (-1);
+      buf[out++] = buf[in++];
+    }
+    if ((code < 0xff) && (in < len))
+      buf[out++] = 0;
+  }
+  return (out);
+}
+
+
+/**
+ * @brief COBS encode a buffer.
+ * 
+ * @param in   - the data to encode
+ * @param len  - its length
+ * @param out  - where to put the result (needs len + 1 + len/254 bytes)
+ * @return int - length of the encoded data (no delimiters are added)
+ */
+int Cobs::encode(const uint8_t *in, int len, uint8_t *out)
+{
+  int codeIdx = 0;
+  int nxtOut = 1;
+  uint8_t code = 1;
+  for (int idx = 0; idx < len; idx++)
+  {
+    if (in[idx] == 0)
+    {
+      out[codeIdx] = code;
+      codeIdx = nxtOut++;
+      code = 1;
+    }
+    else
+    {
+      out[nxtOut++] = in[idx];
+      if (++code == 0xff)
+      {
+        out[codeIdx] = code;
+        codeIdx = nxtOut++;
+        code = 1;
+      }
+    }
+  }
+  out[codeIdx] = code;
+  return (nxtOut);
+}
+
+
+/**
+ * @brief CRC-16/CCITT (poly 0x1021, init 0xFFFF)
+ * 
+ * @param buf 
+ * @param len 
+ * @return uint16_t 
+ */
+uint16_t Cobs::crc16(const uint8_t *buf, int len)
+{
+  uint16_t crc = 0xffff;
+  for (int idx = 0; idx < len; idx++)
+  {
+    crc ^= (uint16_t) buf[idx] << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+  }
+  return (crc);
+}
+
+
+/**
+ * @brief Decode a received frame in place, and check (and drop) its CRC.
+ * 
+ * @param buf  - the encoded frame (no delimiters). Overwritten with the payload.
+ * @param len  - its length
+ * @return int - payload length (1 or more - the CRC is not counted),
+ *               COBS_BAD, or COBS_BAD_CRC
+ */
+int Cobs::unframe(uint8_t *buf, int len)
+{
+  len = decode(buf, len);
+  if (len <= 0)
+    return (COBS_BAD);
+  if (len < 3)
+    return (COBS_BAD_CRC);   // need at least an opcode and the CRC
+
+  len -= 2;
+  uint16_t crc = buf[len] | (buf[len + 1] << 8);
+  if (crc != crc16(buf, len))
+    return (COBS_BAD_CRC);
+  return (len);
+}
+
+
+CobsRx::CobsRx()
+{
+  reset();
+}
+
+
+/**
+ * @brief Forget any partial frame (back to text)
+ */
+void CobsRx::reset()
+{
+  inFrame = false;
+  len = 0;
+}
+
+
+/**
+ * @brief Add one received byte.  (Only call it with 0x00, or while
+ *   active() - anything else is text)
+ * 
+ * @param ch 
+ * @return rxEvent_t - what happened
+ */
+CobsRx::rxEvent_t CobsRx::push(uint8_t ch)
+{
+  if (ch == BIN_FRAME_DELIM)
+  {
+    rxEvent_t event = (inFrame && (len > 0)) ? RX_FRAME : RX_START;
+    inFrame = (event == RX_START);
+    if (event == RX_START)
+      len = 0;
+    return (event);
+  }
+
+  if (len >= BIN_BUF_LEN)
+  { // Too long - can't be one of ours.
+    reset();
+    return (RX_DROPPED);
+  }
+  buf[len++] = ch;
+  return (RX_NONE);
+}
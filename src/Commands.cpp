@@ -28,9 +28,39 @@
 #include <string.h>
 #include <errno.h>
 #include "Commands.h"
+#include "Stats.h"
+#include "CmdQueue.h"
 
 
 #include "CommandList.h"
+#include "Macros.h"
+
+/* STATIC DECLARATIONS */
+const cmdList_t *Commands::cmdIndex[CMD_HASH_SIZE];
+const cmdList_t *Commands::cmdLists[MAX_CMD_LISTS];
+int Commands::noOfCmdLists = 0;
+int Commands::noOfIndexed = 0;
+thread_local Commands *Commands::curSession = nullptr;
+const cmdList_t *Commands::opIndex[BIN_MAX_OPCODE];
+Histogram Commands::cmdStats[CMD_STATS_SIZE];
+uint8_t Commands::statNo[CMD_HASH_SIZE];
+int Commands::noOfTimed = 0;
+
+/**
+ * @brief [INTERNAL] A Stream that goes nowhere.
+ *   Binary commands reply with a status frame, so any text their
+ *   exec function prints is dropped.
+ */
+class NullStream : public Stream
+{
+public:
+  int available() { return (0); }
+  int read() { return (-1); }
+  int peek() { return (-1); }
+  size_t write(uint8_t ch) { return (1); }
+  size_t write(const uint8_t *buf, size_t len) { return (len); }
+};
+static NullStream nullStream;
 
 
 /**
@@ -41,8 +71,10 @@ void Commands::helpCmd(Stream *outStream, int tokCnt, char **tokens) {
   outStream->println();
   Serial.println("GO...");
 
-  for (int idx = 0; cmdList[idx].minTokCount !=0; idx++) {
-    outStream->println(cmdList[idx].descr);
+  for (int lst = 0; lst < noOfCmdLists; lst++) {
+    for (const cmdList_t *cmd = cmdLists[lst]; cmd->minTokCount != 0; cmd++) {
+      outStream->println(cmd->descr);
+    }
   }
   outStream->println("END HELP");
   outStream->println();
@@ -59,24 +91,64 @@ void Commands::helpCmd(Stream *outStream, int tokCnt, char **tokens) {
  */
 void Commands::notImplCmd(Stream *outStream, int tokCnt, char **tokens)
 {
-  outStream->print("Sorry - The '"); outStream->print(tokens[0]); 
-  outStream->print( "' command with "); outStream->print( tokCnt);
-  outStream->println(" tokens is not yet implemented!");
+  ResponseBuf::printTo(outStream, "Sorry - The '%s' command with %d tokens is not yet implemented!\r\n", tokens[0], tokCnt);
 
   for (int idx = 0; idx < tokCnt; idx++)
   {
-    outStream->print("...Token "); outStream->print(idx);
-    outStream->print(" is '");     outStream->print(tokens[idx]);  
-    outStream->println("'");
+    ResponseBuf::printTo(outStream, "...Token %d is '%s'\r\n", idx, tokens[idx]);
   }
   outStream->println(ERR_RESPONSE);
 } 
 
 
+/**
+ * @brief Show (or reset) the latency stats  (see Stats.h)
+ *    stats         - pipeline stages, then each command that has run
+ *    stats reset   - zero them all
+ *   Times are in microseconds. Each  <N:count  is the number of
+ *   samples below N us (and at or above the previous one).
+ * 
+ * @param outStream - where to send the result
+ * @param tokCnt    - how many tokens? 
+ * @param tokens    - list of tokens
+ */
 void Commands::cmd_status(Stream *outStream, int tokCnt, char **tokens)
 {
-  outStream->println("Sorry - Status command is not yet implemented!");
-  ERR_RESPONSE;
+  if (tokCnt == 2)
+  {
+    if (0 != strcasecmp(tokens[1], "reset"))
+    {
+#ifdef VERBOSE_RESPONSES
+      outStream->println("stats: expected 'reset'");
+#endif
+      outStream->println(ERR_RESPONSE);
+      return;
+    }
+    Stats::resetStages();
+    Servos::resetStats();
+    portENTER_CRITICAL(&Stats::statMux);
+    for (int idx = 0; idx < noOfTimed; idx++)
+      cmdStats[idx].reset();
+    portEXIT_CRITICAL(&Stats::statMux);
+    outStream->println(OK_RESPONSE);
+    return;
+  }
+
+  Stats::printStages(outStream);
+  Servos::printStats(outStream);
+  outStream->println("- - - per command (handler time) - - -");
+  for (int slot = 0; slot < CMD_HASH_SIZE; slot++)
+  {
+    if ((cmdIndex[slot] == nullptr) || (statNo[slot] == 0))
+      continue;
+    Histogram copy;
+    portENTER_CRITICAL(&Stats::statMux);
+    copy = cmdStats[statNo[slot] - 1];
+    portEXIT_CRITICAL(&Stats::statMux);
+    if (copy.count > 0)
+      copy.print(outStream, cmdIndex[slot]->name);
+  }
+  outStream->println(OK_RESPONSE);
 }
 
 // Reboot the processor NOW
@@ -91,6 +163,8 @@ void Commands::reboot_cmd(Stream *outStream, int tokCnt, char **tokens) {
 Commands::Commands()
 {
   nxtInBuffer = 0;
+  rxStamp = chunkStamp = eolStamp = 0;
+  fastLane = slowLane = nullptr;
 }
 
 Commands::~Commands() {
@@ -101,7 +175,112 @@ Commands::~Commands() {
 void Commands::begin(Stream *thisIoStream) 
 {
   thisStream = thisIoStream;
+  response.begin(thisIoStream);
+  slowResponse.begin(thisIoStream);
   nxtInBuffer=0;
+  binRx.reset();
+  indexInit();
+
+  if (fastLane == nullptr)
+  { // Start the executors
+    TaskHandle_t task;
+    fastLane = new CmdQueue();
+    xTaskCreatePinnedToCore(fastExecTask, "cmdFast", CMD_EXEC_STACK, this, CMD_FAST_PRIO, &task, CMD_EXEC_CORE);
+    fastLane->begin(task);
+    slowLane = new CmdQueue();
+    xTaskCreatePinnedToCore(slowExecTask, "cmdSlow", CMD_EXEC_STACK, this, CMD_SLOW_PRIO, &task, CMD_EXEC_CORE);
+    slowLane->begin(task);
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] Make sure the built-in list is always the first
+ *   list in the index (so 'help' lists it first, and it wins any
+ *   name clash with a module's list).
+ */
+void Commands::indexInit()
+{
+  if (noOfCmdLists == 0)
+    indexCmdList(cmdList);
+}
+
+
+/**
+ * @brief Add a module's command list to the command index.
+ *    Call this at setup time - the index is NOT locked, and
+ *    sessions read it without any locking.
+ * 
+ * @param list  - the command list. Last entry must have a minTokCount of 0.
+ * @return true  - list was added.
+ * @return false - too many lists, or the index is full.
+ */
+bool Commands::addCmdList(const cmdList_t *list)
+{
+  indexInit();
+  for (int lst = 0; lst < noOfCmdLists; lst++)
+  {
+    if (cmdLists[lst] == list) return (true); // already there
+  }
+  return (indexCmdList(list));
+}
+
+
+/**
+ * @brief [INTERNAL] Insert every (non-comment) entry of a list into 
+ *   the hash index. Collisions use linear probing, so entries with
+ *   the same name keep the order they were added in.
+ * 
+ * @param list  - the command list
+ * @return true  - normal
+ * @return false - too many lists, or the index is full
+ */
+bool Commands::indexCmdList(const cmdList_t *list)
+{
+  if (noOfCmdLists >= MAX_CMD_LISTS)
+  {
+    Serial.println("Commands: too many command lists!");
+    return (false);
+  }
+  cmdLists[noOfCmdLists++] = list;
+
+  for (const cmdList_t *cmd = list; cmd->minTokCount != 0; cmd++)
+  {
+    if ((cmd->opcode > 0) && (cmd->opcode < BIN_MAX_OPCODE) && (cmd->exec != nullptr))
+    {
+      bool textOnly = false;
+      for (int idx = 0; (cmd->argSpec != nullptr) && (idx < cmd->maxTokCount - 1); idx++)
+        textOnly |= (cmd->argSpec[idx].type == ARG_STR);
+
+      if (textOnly)
+        Serial.printf("Commands: opcode 0x%02x (%s) has a string arg - not indexed\n", cmd->opcode, cmd->name);
+      else if (opIndex[cmd->opcode] == nullptr)
+        opIndex[cmd->opcode] = cmd;
+      else
+        Serial.printf("Commands: duplicate opcode 0x%02x (%s)\n", cmd->opcode, cmd->name);
+    }
+
+    if (((cmd->funct == nullptr) && (cmd->exec == nullptr)) || (0 == strcmp(cmd->name, COMMENT)))
+      continue;
+
+    // Always leave at least one empty slot - it ends every lookup.
+    if (noOfIndexed >= CMD_HASH_SIZE - 1)
+    {
+      Serial.println("Commands: command index is full! (increase CMD_HASH_SIZE)");
+      return (false);
+    }
+
+    uint32_t slot = cmd->hash & (CMD_HASH_SIZE - 1);
+    while (cmdIndex[slot] != nullptr)
+      slot = (slot + 1) & (CMD_HASH_SIZE - 1);
+    cmdIndex[slot] = cmd;
+    noOfIndexed++;
+    if (noOfTimed < CMD_STATS_SIZE)
+      statNo[slot] = ++noOfTimed;
+    else
+      Serial.printf("Commands: '%s' is not timed (increase CMD_STATS_SIZE)\n", cmd->name);
+  }
+  return (true);
 }
 
 // Flush the input buffer.
@@ -118,9 +297,27 @@ void Commands::flush() {
  */
 void Commands::recvdChar(char ch)
 {
-   if (isThisEOL(ch) || nxtInBuffer >= CMD_BUF_CHARS) {  // process the buffer
+  chunkStamp = Stats::now();
+  addChar(ch);
+}
+
+
+/**
+ * @brief [INTERNAL] Add this character to the buffer.
+ *   (chunkStamp is when it was received)
+ * 
+ * @param ch 
+ */
+void Commands::addChar(char ch)
+{
+   if ((nxtInBuffer == 0) && !binRx.active())
+      rxStamp = chunkStamp;   // (maybe) the first char of a line or frame
+
+   if ((binRx.active()) || (ch == BIN_FRAME_DELIM)) {
+      recvdBinChar((uint8_t) ch);
+   } else if (isThisEOL(ch) || nxtInBuffer >= CMD_BUF_CHARS) {  // process the buffer
       cmdBuf[nxtInBuffer] = '\0';
-      tokenize();
+      parseAndExecute();
       flush();
     } else {  // add to the buffer
       cmdBuf[nxtInBuffer++] = ch;
@@ -142,33 +339,200 @@ void Commands::recvdChar(char ch)
 void Commands::recvStr(char *inbuf, int len)
 {
   char *bptr=inbuf;
+  chunkStamp = Stats::now();
   for (int pos=0; pos<len; pos++)
   {
-    recvdChar(*bptr++);
+    addChar(*bptr++);
   }
 }
 
 
 /**
- * @brief Build a list of pointers to 
- * 
+ * @brief Split this session's command buffer into commands, 
+ *   and queue them for the executor. Several commands on one line
+ *   are run as one servo batch.
  */
-void Commands::tokenize()
+void Commands::parseAndExecute()
 {
-  int nxtArg=0;
-  static char *tokens[MAX_ARGS];  
-  tokens[0]=strtok(cmdBuf, SEPARATOR );   // first token...
+  char *cmds[MAX_CMDS_PER_LINE];
+  eolStamp = Stats::now();
+  Stats::stage(STAGE_RX_EOL, rxStamp, eolStamp);
+
+  int cmdCnt = Tokenizer::splitLine(cmdBuf, cmds, MAX_CMDS_PER_LINE);
+  if (cmdCnt > 1)
+    queueMarker(JOB_BATCH_BEGIN);
+  for (int idx = 0; idx < cmdCnt; idx++)
+  {
+    execute(cmds[idx], (idx == 0));
+  }
+  if (cmdCnt > 1)
+    queueMarker(JOB_BATCH_END);
+}
 
-  if ((tokens[0] == nullptr) || (strlen(tokens[0]) < 1) )
+
+/**
+ * @brief Tokenize a single command, look it up, and queue it.
+ *   Slow commands (isSlow()) go to the slow lane, all others to the
+ *   fast lane.
+ *   The tokenized text is copied into the job, so this session's
+ *   buffer is free for the next line at once.
+ * 
+ * @param line  - the command. It is modified!
+ * @param first - true if this is the first command on the line
+ */
+void Commands::execute(char *line, bool first)
+{
+  int tokCnt = Tokenizer::tokenize(line, tokens, MAX_ARGS);
+  if (tokCnt == 0)
      return; // blank line ignored
 
-  for (nxtArg=1; nxtArg<MAX_ARGS; nxtArg++)
+  const cmdList_t *cmd = lookup(tokCnt, tokens);
+  CmdQueue *lane = isSlow(cmd, tokCnt, tokens) ? slowLane : fastLane;
+  cmdJob_t *job = lane->claim();
+  char *end = tokens[tokCnt - 1] + strlen(tokens[tokCnt - 1]) + 1;
+
+  job->kind = JOB_TEXT;
+  job->firstOfLine = first;
+  job->cmd = cmd;
+  job->tokCnt = tokCnt;
+  for (int idx = 0; idx < tokCnt; idx++)
+    job->tokOfs[idx] = tokens[idx] - line;
+  memcpy(job->text, line, end - line);
+  job->rxStamp = rxStamp;
+  job->eolStamp = eolStamp;
+  job->fence = fastLane->queued();
+  lane->publish();
+}
+
+
+/**
+ * @brief [INTERNAL] Does a command go to the slow lane?  CMD_SLOW 
+ *   always does - CMD_SLOW_VERB only if its first arg writes flash.
+ * 
+ * @param cmd    - the command (nullptr: not found - fast lane)
+ * @param tokCnt - number of tokens (including the name)
+ * @param tokens - the tokens
+ * @return true  - slow lane
+ */
+bool Commands::isSlow(const cmdList_t *cmd, int tokCnt, char **tokens)
+{
+  if (cmd == nullptr)
+    return (false);
+  if (cmd->flags & CMD_SLOW)
+    return (true);
+  if ((cmd->flags & CMD_SLOW_VERB) && (tokCnt > 1))
+    return ((0 == strcasecmp(tokens[1], "save")) || (0 == strcasecmp(tokens[1], "delete")));
+  return (false);
+}
+
+
+/**
+ * @brief [INTERNAL] Queue a job with no command (batch begin/end) on
+ *   the fast lane.
+ * 
+ * @param kind - JOB_BATCH_BEGIN or JOB_BATCH_END
+ */
+void Commands::queueMarker(jobKind_t kind)
+{
+  cmdJob_t *job = fastLane->claim();
+  job->kind = kind;
+  job->firstOfLine = false;
+  job->cmd = nullptr;
+  job->rxStamp = rxStamp;
+  job->eolStamp = eolStamp;
+  fastLane->publish();
+}
+
+
+/**
+ * @brief [INTERNAL] Executor task - one per lane. Runs the lane's jobs,
+ *   in order, forever. A slow job first waits for the fast lane to
+ *   finish every job that was queued before it (see CmdQueue.h).
+ * 
+ * @param param - the session
+ */
+void Commands::fastExecTask(void *param)
+{
+  Commands *session = (Commands *) param;
+  while (true)
   {
-    tokens[nxtArg] = strtok(NULL, SEPARATOR);
-    if (tokens[nxtArg] == NULL) break;
+    session->runJob(session->fastLane->next(), &session->response);
+    session->fastLane->release();
   }
+}
 
-  dispatch(nxtArg, tokens);
+void Commands::slowExecTask(void *param)
+{
+  Commands *session = (Commands *) param;
+  while (true)
+  {
+    cmdJob_t *job = session->slowLane->next();
+    session->fastLane->waitDone(job->fence);   // everything typed before it has run
+    session->runJob(job, &session->slowResponse);
+    session->slowLane->release();
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] Run one job (on an executor task), and send its
+ *   response.  
+ * 
+ * @param job - the job
+ * @param out - this lane's response buffer
+ */
+void Commands::runJob(cmdJob_t *job, ResponseBuf *out)
+{
+  char *jobTokens[MAX_ARGS];
+  uint32_t start = Stats::now();
+  bool ok = true;
+  curSession = this;
+  Servos::setInputStamp(job->rxStamp);
+
+  switch (job->kind)
+  {
+  case (JOB_TEXT):
+    for (int idx = 0; idx < job->tokCnt; idx++)
+      jobTokens[idx] = &job->text[job->tokOfs[idx]];
+
+    if (Macros::isRecording(this) && (0 != strcasecmp(jobTokens[0], "macro")))
+    { // Save it for later - don't execute it
+      Macros::record(out, job->tokCnt, jobTokens);
+      out->flush();
+      return;
+    }
+
+    if (job->cmd == nullptr)
+    {
+#ifdef VERBOSE_RESPONSES
+      out->appendf("ERROR: Command '%s' not found\r\n", jobTokens[0]);
+#endif
+      out->println(ERR_RESPONSE);
+      break;
+    }
+    ok = run(out, job->cmd, job->tokCnt, jobTokens);
+    timeCmd(job, start, ok);
+    break;
+
+  case (JOB_BINARY):
+    ok = job->cmd->exec(&nullStream, &job->args);
+    timeCmd(job, start, ok);
+    binReply(out, job->opcode, ok ? BIN_OK : BIN_ERR_FAILED);
+    break;
+
+  case (JOB_BIN_REPLY):
+    binReply(out, job->opcode, job->status);
+    break;
+
+  case (JOB_BATCH_BEGIN):
+    Servos::beginBatch();
+    break;
+
+  case (JOB_BATCH_END):
+    Servos::commitBatch();
+    break;
+  }
+  out->flush();
 }
 
 
@@ -176,35 +540,350 @@ const char *msg1 = "ER: Unknown command";
 
 
 /**
- * @brief Find the matching command (if any) and execute it.
- *   (report unknown command...)
+ * @brief Find the matching command (if any)
  * 
+ * @param tokCnt  - how many tokens?
+ * @param tokens  - list of tokens. tokens[0] is the command name
+ * @return const cmdList_t* - the command, or nullptr if not found
  */
-void Commands::dispatch(int tokCnt, char **tokens)
+const cmdList_t *Commands::lookup(int tokCnt, char **tokens)
 {
+  uint32_t hash = cmdHash(tokens[0]);
 
-  for (int cmdidx = 0; cmdList[cmdidx].minTokCount != 0; cmdidx++)
+  for (uint32_t slot = hash & (CMD_HASH_SIZE - 1); cmdIndex[slot] != nullptr; slot = (slot + 1) & (CMD_HASH_SIZE - 1))
   {
-    if (0 != strcasecmp(tokens[0], cmdList[cmdidx].name))
+    const cmdList_t *cmd = cmdIndex[slot];
+    if ((cmd->hash != hash) || (0 != strcasecmp(tokens[0], cmd->name)))
       continue;
 
-    if (0 == strcmp(tokens[0], COMMENT))
+    if ((tokCnt < cmd->minTokCount) || (tokCnt > cmd->maxTokCount))
       continue;
 
-    if ((tokCnt < cmdList[cmdidx].minTokCount) || (tokCnt > cmdList[cmdidx].maxTokCount))
+    // Right command, right arg count - GOT IT!
+    return (cmd);
+  }
+  return (nullptr);
+}
+
+
+/**
+ * @brief [INTERNAL] Record the timing of a command that just ran.
+ * 
+ * @param job   - the command's job
+ * @param start - Stats::now() when its handler started
+ * @param ok    - did it work?
+ */
+void Commands::timeCmd(const cmdJob_t *job, uint32_t start, bool ok)
+{
+  uint32_t end = Stats::now();
+  const cmdList_t *cmd = job->cmd;
+  if (job->firstOfLine)
+    Stats::stage(STAGE_EOL_RUN, job->eolStamp, start);
+  Stats::stage(STAGE_HANDLER, start, end);
+
+  for (uint32_t slot = cmd->hash & (CMD_HASH_SIZE - 1); cmdIndex[slot] != nullptr; slot = (slot + 1) & (CMD_HASH_SIZE - 1))
+  {
+    if (cmdIndex[slot] == cmd)
+    {
+      if (statNo[slot] != 0)
+        Stats::add(&cmdStats[statNo[slot] - 1], start, end, ok);   // (under Stats::statMux)
+      return;
+    }
+  }
+}
+
+
+/**
+ * @brief Run a command that has been looked up.
+ *   A schema command has its args decoded (and checked) first, and 
+ *   we send its OK/ERR response. A token command sends its own.
+ * 
+ * @param outStream - where to send the response
+ * @param cmd       - the command
+ * @param tokCnt    - how many tokens
+ * @param tokens    - list of tokens (tokens[0] is the command name)
+ * @return true     - normal (always, for a token command)
+ * @return false    - bad args, or the command failed
+ */
+bool Commands::run(Stream *outStream, const cmdList_t *cmd, int tokCnt, char **tokens)
+{
+  if (cmd->exec == nullptr)
+  {
+    cmd->funct(outStream, tokCnt, tokens);
+    return (true);
+  }
+
+  cmdArgs_t args;
+  bool ok = decodeArgs(outStream, cmd, tokCnt, tokens, &args) && cmd->exec(outStream, &args);
+  outStream->println(ok ? OK_RESPONSE : ERR_RESPONSE);
+  return (ok);
+}
+
+
+/**
+ * @brief The session whose command is running on this task (if any).
+ *   Lets a command function find its session - e.g. to change
+ *   that session's state.
+ * 
+ * @return Commands* - the session, nullptr if none
+ */
+Commands *Commands::current()
+{
+  return (curSession);
+}
+
+
+/**
+ * @brief Decode (and range check) a command's text arguments, as
+ *   listed in its schema. ARG_SERVO args may be a servo name, ARG_CDEG
+ *   args are decimal degrees (see Tokenizer::decodeCdeg).
+ *   Only an error message is sent - the caller sends ERR_RESPONSE.
+ * 
+ * @param outStream - where to send error messages.
+ * @param cmd       - the command (a schema command)
+ * @param tokCnt    - how many tokens
+ * @param tokens    - list of tokens (tokens[0] is the command name)
+ * @param args      - where to put the result
+ * @return true     - all args decoded
+ * @return false    - bad arg (error has been reported)
+ */
+bool Commands::decodeArgs(Stream *outStream, const cmdList_t *cmd, int tokCnt, char **tokens, cmdArgs_t *args)
+{
+  args->argCnt = tokCnt - 1;
+  args->tokens = tokens;
+  if ((args->argCnt > 0) && (cmd->argSpec == nullptr))
+    return (false);   // bad table entry
+
+  for (int idx = 0; idx < args->argCnt; idx++)
+  {
+    const argSpec_t *spec = &cmd->argSpec[idx];
+    const char *token = tokens[idx + 1];
+    args->val[idx] = 0;
+    if (spec->type == ARG_STR)
       continue;
 
-    // Right command, right arg count - GOT IT!
-    cmdList[cmdidx].funct(thisStream, tokCnt, tokens);
+    long val = -1;
+    if (spec->type == ARG_SERVO)
+      val = Servos::decodeId(token);
+
+    if (spec->type == ARG_CDEG)
+    {
+      if (!Tokenizer::decodeCdeg(token, &val))
+      {
+#ifdef VERBOSE_RESPONSES
+        ResponseBuf::printTo(outStream, "%s: '%s' is not a valid %s\r\n", tokens[0], token, spec->label);
+#endif
+        return (false);
+      }
+    }
+    else if (val < 0)
+    {
+      char *endPtr;
+      errno = 0;
+      val = strtol(token, &endPtr, 10);
+      if ((errno != 0) || (endPtr == token) || (*endPtr != '\0'))
+      {
+#ifdef VERBOSE_RESPONSES
+        ResponseBuf::printTo(outStream, "%s: '%s' is not a valid %s\r\n", tokens[0], token, spec->label);
+#endif
+        return (false);
+      }
+    }
+
+    if (!checkArg(outStream, spec, val))
+      return (false);
+    args->val[idx] = val;
+  }
+  return (true);
+}
+
+
+/**
+ * @brief [INTERNAL] Range check one decoded arg against its schema entry.
+ *   (Used for both text and binary args)
+ * 
+ * @param outStream - where to send error messages.
+ * @param spec      - schema entry for this arg
+ * @param val       - the value
+ * @return true     - in range
+ * @return false    - out of range (error has been reported)
+ */
+bool Commands::checkArg(Stream *outStream, const argSpec_t *spec, long val)
+{
+  if ((val >= spec->minVal) && (val <= spec->maxVal))
+    return (true);
+#ifdef VERBOSE_RESPONSES
+  ResponseBuf::printTo(outStream, "%s %ld is out of range (%d..%d)\r\n", spec->label, val, (int)spec->minVal, (int)spec->maxVal);
+#endif
+  return (false);
+}
+
+
+/**
+ * @brief [INTERNAL] Collect a binary frame (see CobsRx).
+ *   The first 0x00 starts the frame (and discards any partial text
+ *   line), the next 0x00 ends it. An over-long frame is dropped, and
+ *   we go back to text mode.
+ * 
+ * @param ch 
+ */
+void Commands::recvdBinChar(uint8_t ch)
+{
+  switch (binRx.push(ch))
+  {
+  case CobsRx::RX_FRAME:
+    eolStamp = Stats::now();
+    Stats::stage(STAGE_RX_EOL, rxStamp, eolStamp);
+    binDispatch();
+    break;
+
+  case CobsRx::RX_START:
+    flush();
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] Decode (and check) a complete binary frame, and
+ *   queue it for the executor. Decoding is done in place, in binRx.buf.
+ */
+void Commands::binDispatch()
+{
+  uint8_t *binBuf = binRx.buf;
+  int len = Cobs::unframe(binBuf, binRx.len);
+  if (len < 0)
+  {
+    binError((len == COBS_BAD_CRC) ? binBuf[0] : 0, BIN_ERR_CRC);
     return;
   }
-  #ifdef VERBOSE_RESPONSES
-  thisStream->println("ERROR: Command not found");
-  #endif
-  thisStream->println(ERR_RESPONSE);
-  return;
+
+  uint8_t opcode = binBuf[0];
+
+  const cmdList_t *cmd = (opcode < BIN_MAX_OPCODE) ? opIndex[opcode] : nullptr;
+  if (cmd == nullptr)
+  {
+    binError(opcode, BIN_ERR_OPCODE);
+    return;
+  }
+
+  // Unpack (and check) the fixed-width little-endian args
+  cmdArgs_t args;
+  const uint8_t *src = &binBuf[1];
+  const uint8_t *end = &binBuf[len];
+  args.argCnt = 0;
+  args.tokens = nullptr;
+  while ((src < end) && (args.argCnt < cmd->maxTokCount - 1))
+  {
+    const argSpec_t *spec = &cmd->argSpec[args.argCnt];
+    int32_t val;
+    switch (spec->type)
+    {
+    case (ARG_INT8):
+      val = (int8_t) src[0];
+      src += 1;
+      break;
+
+    case (ARG_SERVO):
+      val = src[0];
+      src += 1;
+      break;
+
+    case (ARG_INT16):
+    case (ARG_CDEG):
+      if (end - src < 2) { binError(opcode, BIN_ERR_LENGTH); return; }
+      val = (int16_t) (src[0] | (src[1] << 8));
+      src += 2;
+      break;
+
+    case (ARG_INT32):
+      if (end - src < 4) { binError(opcode, BIN_ERR_LENGTH); return; }
+      val = (int32_t) ((uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24));
+      src += 4;
+      break;
+
+    default:
+      binError(opcode, BIN_ERR_OPCODE);  // bad schema in the table
+      return;
+    }
+
+    if (!checkArg(&nullStream, spec, val))
+    {
+      binError(opcode, BIN_ERR_FAILED);
+      return;
+    }
+    args.val[args.argCnt++] = val;
+  }
+
+  if ((src != end) || (args.argCnt < cmd->minTokCount - 1))
+  {
+    binError(opcode, BIN_ERR_LENGTH);
+    return;
+  }
+
+  CmdQueue *lane = (cmd->flags & CMD_SLOW) ? slowLane : fastLane;
+  cmdJob_t *job = lane->claim();
+  job->kind = JOB_BINARY;
+  job->firstOfLine = true;
+  job->cmd = cmd;
+  job->opcode = opcode;
+  job->args = args;
+  job->rxStamp = rxStamp;
+  job->eolStamp = eolStamp;
+  job->fence = fastLane->queued();
+  lane->publish();
 }
 
+
+/**
+ * @brief [INTERNAL] Queue the reply for a bad binary frame.
+ *   (It goes through the fast lane, so replies stay in order)
+ * 
+ * @param opcode - the opcode we are replying to
+ * @param status - one of the BIN_ERR_xxx codes
+ */
+void Commands::binError(uint8_t opcode, uint8_t status)
+{
+  cmdJob_t *job = fastLane->claim();
+  job->kind = JOB_BIN_REPLY;
+  job->firstOfLine = false;
+  job->cmd = nullptr;
+  job->opcode = opcode;
+  job->status = status;
+  job->rxStamp = rxStamp;
+  job->eolStamp = eolStamp;
+  fastLane->publish();
+}
+
+
+/**
+ * @brief [INTERNAL] Send a binary reply frame: <opcode> <status> <crc16>
+ * 
+ * @param out    - where to send it
+ * @param opcode - the opcode we are replying to
+ * @param status - BIN_OK or one of the BIN_ERR_xxx codes
+ */
+void Commands::binReply(ResponseBuf *out, uint8_t opcode, uint8_t status)
+{
+  uint8_t payload[4];
+  uint8_t frame[sizeof(payload) + 3];
+
+  payload[0] = opcode;
+  payload[1] = status;
+  uint16_t crc = Cobs::crc16(payload, 2);
+  payload[2] = crc & 0xff;
+  payload[3] = crc >> 8;
+
+  frame[0] = BIN_FRAME_DELIM;
+  int len = 1 + Cobs::encode(payload, sizeof(payload), &frame[1]);
+  frame[len++] = BIN_FRAME_DELIM;
+  out->write(frame, len);
+}
+
+
 /**
  * @brief Handle function to search the argument list for a specific argument
  * 
@@ -269,6 +948,7 @@ void Commands::dispatch(int tokCnt, char **tokens)
       outStream->println("Value is out of range");
 #endif
       outStream->println(ERR_RESPONSE);
+      return (false);
     }
     *val = res;
     return (true); // Good value
@@ -321,7 +1001,9 @@ void Commands::dispatch(int tokCnt, char **tokens)
       outStream->println("Value is out of range");
 #endif
       outStream->println(ERR_RESPONSE);
+      return (false);
     }
+    *val = res;
     return (true); // Good value
   }
   
\ No newline at end of file
@@ -0,0 +1,197 @@
+/**
+ * @file I2cBus.cpp
+ * @author Doug Fajardo
+ * @brief  Queued (non-blocking) I2C writes for the servo boards
+ * @version 0.1
+ * @date 2024-09-25
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Config.h"
+#include "I2cBus.h"
+#include "Stats.h"
+#include "ResponseBuf.h"
+#include <Wire.h>
+#include "driver/i2c.h"
+#include "driver/gpio.h"
+
+// Wire's port - we share its driver
+#define SERVO_I2C_PORT   I2C_NUM_0
+
+/* STATIC DECLARATIONS */
+QueueHandle_t I2cBus::queue = nullptr;
+TaskHandle_t I2cBus::busTask = nullptr;
+uint32_t I2cBus::clockHz = SERVO_I2C_CLOCK;
+I2cBus::i2cStats_t I2cBus::counts;
+portMUX_TYPE I2cBus::countMux = portMUX_INITIALIZER_UNLOCKED;
+
+#define COUNT(__field__, __n__)  do { portENTER_CRITICAL(&countMux); counts.__field__ += (__n__); portEXIT_CRITICAL(&countMux); } while (0)
+
+
+/**
+ * @brief Run time setup. Wire must already be started (the servo 
+ *   driver's begin() does that).
+ *
+ * @param clock - bus clock (Hz)
+ */
+void I2cBus::begin(uint32_t clock)
+{
+  clockHz = clock;
+  Wire.setClock(clockHz);
+  if (queue == nullptr)
+  {
+    queue = xQueueCreate(I2C_QUEUE_LEN, sizeof(i2cXfer_t));
+    xTaskCreatePinnedToCore(busLoop, "i2cBus", I2C_TASK_STACK, nullptr, I2C_TASK_PRIO, &busTask, I2C_TASK_CORE);
+  }
+}
+
+
+/**
+ * @brief Queue a write. The transfer is copied - the caller's copy may
+ *   be reused at once. Never waits: if the queue is full, the write is
+ *   dropped (counted as an overrun) and false is returned - the 'done'
+ *   function is NOT called.
+ *
+ * @param xfer - the write
+ * @return true  - queued
+ * @return false - queue full (or not started)
+ */
+bool I2cBus::submit(i2cXfer_t *xfer)
+{
+  xfer->queued = Stats::now();
+  if ((queue == nullptr) || (xQueueSend(queue, xfer, 0) != pdTRUE))
+  {
+    COUNT(overruns, 1);
+    return (false);
+  }
+  return (true);
+}
+
+
+/**
+ * @brief [INTERNAL] The bus task - send each queued write, retrying
+ *   (and recovering the bus) as needed, then report the result.
+ */
+void I2cBus::busLoop(void *param)
+{
+  static i2cXfer_t xfer;    // (big - keep it off the stack)
+  while (true)
+  {
+    if (xQueueReceive(queue, &xfer, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    bool ok = false;
+    for (int attempt = 0; attempt <= I2C_RETRIES; attempt++)
+    {
+      if (attempt > 0)
+        COUNT(retries, 1);
+
+      int res = transfer(&xfer);
+      if (res == ESP_OK)
+      {
+        ok = true;
+        break;
+      }
+      if (res == ESP_FAIL)
+        COUNT(nacks, 1);       // no ACK - the board may be busy (or absent)
+      else
+      {
+        COUNT(timeouts, 1);    // bus stuck - clear it
+        recover();
+      }
+    }
+
+    if (ok)
+    {
+      COUNT(xfers, 1);
+      COUNT(bytes, xfer.len);
+    }
+    else
+      COUNT(failed, 1);
+
+    if (xfer.done != nullptr)
+      xfer.done(&xfer, ok);
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] Send one write: START, address, data, STOP.
+ *
+ * @param xfer - the write
+ * @return int - ESP_OK, ESP_FAIL (NACK), or ESP_ERR_TIMEOUT (bus busy)
+ */
+int I2cBus::transfer(const i2cXfer_t *xfer)
+{
+  uint8_t link[I2C_LINK_RECOMMENDED_SIZE(2)];
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link, sizeof(link));
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (xfer->addr << 1) | I2C_MASTER_WRITE, true);
+  i2c_master_write(cmd, xfer->data, xfer->len, true);
+  i2c_master_stop(cmd);
+  esp_err_t res = i2c_master_cmd_begin(SERVO_I2C_PORT, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+  i2c_cmd_link_delete_static(cmd);
+  return (res);
+}
+
+
+/**
+ * @brief [INTERNAL] Clear a stuck bus: take the pins from the driver,
+ *   clock SCL (up to 9 times) until the slave lets go of SDA, send a
+ *   STOP, and start the driver again.
+ */
+void I2cBus::recover()
+{
+  COUNT(recoveries, 1);
+  Wire.end();
+
+  gpio_num_t sda = (gpio_num_t)SERVO_I2C_DATA_PIN;
+  gpio_num_t scl = (gpio_num_t)SERVO_I2C_CLOCK_PIN;
+  // Wire.end() leaves the pins routed to the I2C peripheral (GPIO
+  //  matrix) - take them back, or the clocks never reach the bus
+  gpio_reset_pin(sda);
+  gpio_reset_pin(scl);
+  gpio_set_level(sda, 1);
+  gpio_set_level(scl, 1);
+  gpio_set_direction(sda, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_direction(scl, GPIO_MODE_INPUT_OUTPUT_OD);
+  for (int clk = 0; (clk < 9) && (gpio_get_level(sda) == 0); clk++)
+  {
+    gpio_set_level(scl, 0);
+    ets_delay_us(5);
+    gpio_set_level(scl, 1);
+    ets_delay_us(5);
+  }
+  // STOP: SDA low -> high while SCL is high
+  gpio_set_level(scl, 0);
+  ets_delay_us(5);
+  gpio_set_level(sda, 0);
+  ets_delay_us(5);
+  gpio_set_level(scl, 1);
+  ets_delay_us(5);
+  gpio_set_level(sda, 1);
+  ets_delay_us(5);
+
+  Wire.begin(SERVO_I2C_DATA_PIN, SERVO_I2C_CLOCK_PIN, clockHz);
+}
+
+
+void I2cBus::printStats(Stream *outStream)
+{
+  i2cStats_t copy;
+  portENTER_CRITICAL(&countMux);
+  copy = counts;
+  portEXIT_CRITICAL(&countMux);
+  ResponseBuf::printTo(outStream, "i2c (%u kHz): xfers: %u (%u bytes)  nacks: %u  timeouts: %u  retries: %u  failed: %u  recoveries: %u  overruns: %u\r\n",
+                                  clockHz / 1000, copy.xfers, copy.bytes, copy.nacks, copy.timeouts, copy.retries,
+                                  copy.failed, copy.recoveries, copy.overruns);
+}
+
+
+void I2cBus::resetStats()
+{
+  portENTER_CRITICAL(&countMux);
+  memset(&counts, 0, sizeof(counts));
+  portEXIT_CRITICAL(&countMux);
+}
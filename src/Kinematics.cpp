@@ -10,21 +10,48 @@
  * Rot, Jaw angles are just strraight trig, mapped by the SERVO library
  * Leye and Reye are trig, with the brightness as the scaling factor.
  * 
- * NOD and TILT are more complex. We use the following constants:
+ * NOD and TILT are more complex. We use the following constants
+ * (in Prefs - see Kinematics.h):
  * NOD_BASE is the distance from the center to the line LEFT to RIGHT.
  * TILT_BASE is1/2 ther length of the line from LEFT to RIGHT.
  * ARM_LENGTH is the length of the arm on the LEFT or RIGHT servos.
  */
 #include "Kinematics.h"
 #include "Servos.h"
+#include "Prefs.h"
 #include "limits.h"
+#include "FixMath.h"
 #include "Commands.h"
 
+/* STATIC DECLARATIONS */
+Kinematics::kinEntry_t Kinematics::table[KIN_TILT_STEPS][KIN_NOD_STEPS];
+int Kinematics::builtGeometry[3] = {0, 0, 0};
+bool Kinematics::tableBuilt = false;
+SemaphoreHandle_t Kinematics::kinLock = nullptr;
+cdeg_t Kinematics::curTilt = 0;
+cdeg_t Kinematics::curNod = 0;
+
+static_assert((KIN_TILT_MAX % KIN_STEP_DEG == 0) && (KIN_NOD_MAX % KIN_STEP_DEG == 0),
+              "KIN_TILT_MAX and KIN_NOD_MAX must be multiples of KIN_STEP_DEG");
+
 Kinematics::Kinematics()
 {
 
 }
 
+
+/**
+ * @brief Run time setup - build the pose table (Prefs must be set up)
+ */
+void Kinematics::begin()
+{
+    if (kinLock == nullptr)
+        kinLock = xSemaphoreCreateMutex();
+    xSemaphoreTake(kinLock, portMAX_DELAY);
+    refreshTable();
+    xSemaphoreGive(kinLock);
+}
+
 Kinematics::~Kinematics()
 {
 
@@ -37,11 +64,22 @@ Kinematics::~Kinematics()
  */
 void Kinematics::rot(int angle)
 {
-    Servos::setServoAngle(ROT_SERVO, angle);
+    rotCd(angle * CDEG_PER_DEG);
     return;
 }
 
 
+/**
+ * @brief Set the head rotation angle - in centidegrees
+ * 
+ * @param angle - desired angle (1/100 degree)
+ */
+void Kinematics::rotCd(cdeg_t angle)
+{
+    Servos::setServoAngleCd(ROT_SERVO, angle);
+}
+
+
 /**
  * @brief Set the Jaw angle
  *  
@@ -49,11 +87,22 @@ void Kinematics::rot(int angle)
  */
 void Kinematics::jaw(int angle)
 {
-    Servos::setServoAngle(JAW_SERVO, angle);
+    jawCd(angle * CDEG_PER_DEG);
     return;
 }
 
 
+/**
+ * @brief Set the Jaw angle - in centidegrees
+ * 
+ * @param angle - desired angle (1/100 degree)
+ */
+void Kinematics::jawCd(cdeg_t angle)
+{
+    Servos::setServoAngleCd(JAW_SERVO, angle);
+}
+
+
 /**
  * @brief Set the left eye to a given brightness
  * 
@@ -109,49 +158,153 @@ void Kinematics::getEyes(int *direction, int *bright)
     *direction = atan( (leye/ (*bright)) / (reye/ (*bright)) );
 }
 
-// Dist center to line between LEFT and RIGHT (at headplate)
-#define NOD_BASE  1.0
-// 1/2 the Dist from LEFT to RIGHT, 
-#define TILT_BASE 1.0
+/**
+ * @brief [INTERNAL] Rebuild the pose table if the geometry (Prefs) is
+ *   not what it was built for.  (Caller must hold kinLock)
+ */
+void Kinematics::refreshTable()
+{
+    int geom[3];
+    Prefs::headGeometry(&geom[0], &geom[1], &geom[2]);
+    if (tableBuilt && (0 == memcmp(geom, builtGeometry, sizeof(geom))))
+        return;
+    buildTable(geom[0], geom[1], geom[2]);
+    memcpy(builtGeometry, geom, sizeof(geom));
+    tableBuilt = true;
+}
+
+
+/**
+ * @brief [INTERNAL] Solve the LEFT/RIGHT servo angles for every 
+ *   KIN_STEP_DEG of tilt x nod (closed form - see Kinematics.h).
+ *   (Caller must hold kinLock)
+ * 
+ * @param nodBase  - pivot to the LEFT-RIGHT line (mm)
+ * @param tiltBase - 1/2 of LEFT to RIGHT (mm)
+ * @param armLen   - servo arm (mm)
+ */
+void Kinematics::buildTable(int nodBase, int tiltBase, int armLen)
+{
+    const float degRad = M_PI / 180.0f;
+    const float radCdeg = 180.0f * CDEG_PER_DEG / M_PI;
+    if (armLen <= 0) armLen = 1;
+    for (int ti = 0; ti < KIN_TILT_STEPS; ti++)
+    {
+        float t = (ti * KIN_STEP_DEG - KIN_TILT_MAX) * degRad;
+        for (int ni = 0; ni < KIN_NOD_STEPS; ni++)
+        {
+            float n = (ni * KIN_STEP_DEG - KIN_NOD_MAX) * degRad;
+            float lift = nodBase * sinf(n);
+            float tip = tiltBase * sinf(t) * cosf(n);
+            float right = constrain((lift + tip) / armLen, -1.0f, 1.0f);
+            float left = constrain((lift - tip) / armLen, -1.0f, 1.0f);
+            table[ti][ni].right = lroundf(asinf(right) * radCdeg);
+            table[ti][ni].left = lroundf(asinf(left) * radCdeg);
+        }
+    }
+}
 
-// Length of servo arm
-#define ARM_LEN   1.0
 
+/**
+ * @brief [INTERNAL] LEFT/RIGHT servo angles for a tilt and nod: 
+ *   bilinear interpolation in the table.  (Caller must hold kinLock)
+ * 
+ * @param tilt  - tilt (centidegrees - clamped to the table)
+ * @param nod   - nod (centidegrees - clamped to the table)
+ * @param right - where to put the RIGHT servo angle (centidegrees)
+ * @param left  - ... and the LEFT
+ */
+void Kinematics::lookup(cdeg_t tilt, cdeg_t nod, cdeg_t *right, cdeg_t *left)
+{
+    const int32_t span = KIN_STEP_DEG * CDEG_PER_DEG;
+    tilt = constrain(tilt, -KIN_TILT_MAX * CDEG_PER_DEG, KIN_TILT_MAX * CDEG_PER_DEG);
+    nod = constrain(nod, -KIN_NOD_MAX * CDEG_PER_DEG, KIN_NOD_MAX * CDEG_PER_DEG);
+
+    // cell, and where in it (0...span)
+    int32_t tOfs = tilt + KIN_TILT_MAX * CDEG_PER_DEG;
+    int32_t nOfs = nod + KIN_NOD_MAX * CDEG_PER_DEG;
+    int ti = tOfs / span;
+    int ni = nOfs / span;
+    if (ti >= KIN_TILT_STEPS - 1) ti = KIN_TILT_STEPS - 2;   // (the far edge)
+    if (ni >= KIN_NOD_STEPS - 1) ni = KIN_NOD_STEPS - 2;
+    int32_t tf = tOfs - ti * span;
+    int32_t nf = nOfs - ni * span;
+
+    const kinEntry_t *c00 = &table[ti][ni];
+    const kinEntry_t *c10 = &table[ti + 1][ni];
+    const kinEntry_t *c01 = &table[ti][ni + 1];
+    const kinEntry_t *c11 = &table[ti + 1][ni + 1];
+    *right = bilerp(c00->right, c10->right, c01->right, c11->right, tf, nf, span);
+    *left = bilerp(c00->left, c10->left, c01->left, c11->left, tf, nf, span);
+}
+
+
+/**
+ * @brief Tilt and nod the head together (degrees)
+ * 
+ * @param tilt_angle - tilt (+: RIGHT side up)
+ * @param nod_angle  - nod (+: up)
+ */
 void Kinematics::pose(int tilt_angle, int nod_angle)
 {
-    double req_dist_left;
-    double req_dist_right;
-    // *** Distance to move to NOD a given angle (LEFT and RIGHT move equally)
-    req_dist_left= sin(nod_angle)*NOD_BASE;
-    
-    // *** TILT - how much to offset one side (LEFT and RIGHT move opposite each other)
-    req_dist_right += sin(tilt_angle)*TILT_BASE;
-    req_dist_left -= sin(tilt_angle)*TILT_BASE;
-
-    // *** Convert dist_Req to angle
-    double angle_right = asin(req_dist_right/ARM_LEN);
-    double angle_left  = asin(req_dist_left/ARM_LEN);
+    poseCd(tilt_angle * CDEG_PER_DEG, nod_angle * CDEG_PER_DEG);
 }
 
-void Kinematics::tilt(int angle)
+
+/**
+ * @brief Tilt and nod the head together (centidegrees). LEFT and RIGHT
+ *   go out in one batch - the same frame. Angles beyond the table are
+ *   clamped to it.
+ * 
+ * @param tilt_angle - tilt (+: RIGHT side up)
+ * @param nod_angle  - nod (+: up)
+ */
+void Kinematics::poseCd(cdeg_t tilt_angle, cdeg_t nod_angle)
 {
-    // TODO
+    cdeg_t right, left;
+    if (kinLock == nullptr)
+        return;   // (not started)
+    xSemaphoreTake(kinLock, portMAX_DELAY);
+    refreshTable();
+    lookup(tilt_angle, nod_angle, &right, &left);
+    curTilt = tilt_angle;
+    curNod = nod_angle;
+    xSemaphoreGive(kinLock);
+
+    Servos::beginBatch();
+    Servos::setServoAngleCd(RIGHT_SERVO, right);
+    Servos::setServoAngleCd(LEFT_SERVO, left);
+    Servos::commitBatch();
 }
 
-void Kinematics::nod(int angle)
+
+/**
+ * @brief Tilt the head (degrees) - the nod stays as it is
+ */
+void Kinematics::tilt(int angle)
 {
-    // TODO
+    tiltCd(angle * CDEG_PER_DEG);
 }
 
+void Kinematics::tiltCd(cdeg_t angle)
+{
+    poseCd(angle, curNod);
+}
 
 
 /**
- * @brief 
- * 
- *         void tilt(int angle);
-        void nod(int angle);
-        void pose(int tilt_angle, int nod_angle);
+ * @brief Nod the head (degrees) - the tilt stays as it is
  */
+void Kinematics::nod(int angle)
+{
+    nodCd(angle * CDEG_PER_DEG);
+}
+
+void Kinematics::nodCd(cdeg_t angle)
+{
+    poseCd(curTilt, angle);
+}
+
 
 /* - - - - - - -  COMMANDS - - - - - - - - - */
 /**
@@ -233,27 +386,85 @@ void Kinematics::eyes_cmd(Stream *outstream, int tokCnt, char **tokens)
 }
 
 /**
- * @brief Set both NOD and TILT 
- *    
+ * @brief Set the tilt angle (the nod stays as it is)
+ *     tilt <degrees>    (may have 2 decimals: 12.25)
+ * 
  * @param outstream  - where to send response
- * @param tokCnt     - how many tokens?
- * @param tokens     - list of tokens
+ * @param args       - tilt (centidegrees - range checked by the dispatcher)
+ * @return true      - always
  */
-void Kinematics::pose_cmd(Stream *outstream, int tokCnt, char **tokens)
+bool Kinematics::tiltExec(Stream *outstream, const cmdArgs_t *args)
 {
-    // NOD angle...
-    
-        outstream->println(ERR_RESPONSE);
+    tiltCd(args->val[0]);
+    return (true);
 }
 
 
-void Kinematics::tilt_cmd(Stream *outstream, int tokCnt, char **tokens)
+/**
+ * @brief Set the nod angle (the tilt stays as it is)
+ *     nod <degrees>
+ * 
+ * @param outstream  - where to send response
+ * @param args       - nod (centidegrees - range checked by the dispatcher)
+ * @return true      - always
+ */
+bool Kinematics::nodExec(Stream *outstream, const cmdArgs_t *args)
 {
-    // TODO
+    nodCd(args->val[0]);
+    return (true);
 }
 
-void Kinematics::nod_cmd(Stream *outstream, int tokCnt, char **tokens)
+
+/**
+ * @brief Set both NOD and TILT 
+ *     pose <tilt degrees> <nod degrees>
+ *    
+ * @param outstream  - where to send response
+ * @param args       - tilt, nod (centidegrees - range checked by the dispatcher)
+ * @return true      - always
+ */
+bool Kinematics::poseExec(Stream *outstream, const cmdArgs_t *args)
 {
-    // TODO
+    poseCd(args->val[0], args->val[1]);
+    return (true);
 }
 
+
+/**
+ * @brief Get/set the head linkage geometry (Prefs - mm). The pose
+ *   table is rebuilt at once.  (DONT forget to COMMIT your change!)
+ *     geometry
+ *     geometry <nodBase> <tiltBase> <armLen>
+ * 
+ * @param outstream  - where to send response
+ * @param args       - none, or all 3 (range checked by the dispatcher)
+ * @return true      - normal
+ * @return false     - 1 or 2 args
+ */
+bool Kinematics::geometryExec(Stream *outstream, const cmdArgs_t *args)
+{
+    if ((args->argCnt != 0) && (args->argCnt != 3))
+    {
+#ifdef VERBOSE_RESPONSES
+        outstream->println("geometry needs all 3 lengths (or none)");
+#endif
+        return (false);
+    }
+    if (args->argCnt == 3)
+    {
+        Prefs::headGeometry(args->val[0], args->val[1], args->val[2]);
+        if (kinLock != nullptr)
+        {
+            xSemaphoreTake(kinLock, portMAX_DELAY);
+            refreshTable();
+            xSemaphoreGive(kinLock);
+        }
+    }
+
+#ifdef VERBOSE_RESPONSES
+    int geom[3];
+    Prefs::headGeometry(&geom[0], &geom[1], &geom[2]);
+    ResponseBuf::printTo(outstream, "nod base %d mm  tilt base %d mm  arm %d mm\r\n", geom[0], geom[1], geom[2]);
+#endif
+    return (true);
+}
@@ -0,0 +1,152 @@
+/**
+ * @file LedcBackend.cpp
+ * @author Doug Fajardo
+ * @brief  PWM backend: the ESP32's own LEDC channels, on GPIO pins
+ * @version 0.1
+ * @date 2024-09-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Config.h"
+#include "LedcBackend.h"
+#include "Stats.h"
+
+// Each speed mode has its own 8 channels (and timers)
+#define LEDC_CHANS_PER_MODE   8
+#define LEDC_SERVO_TIMER      LEDC_TIMER_0
+
+static_assert(LEDC_RES_BITS >= 8 && LEDC_RES_BITS <= 20, "LEDC_RES_BITS out of range");
+
+
+LedcBackend::LedcBackend(int board)
+    : boardNo(board), freq(SERVO_PWM_FREQ)
+{
+}
+
+
+/**
+ * @brief [INTERNAL] LEDC speed mode / channel number for a board channel.
+ *   Channels 0-7 are high speed (on chips that have it), 8-15 low speed.
+ */
+ledc_mode_t LedcBackend::chanMode(int chan)
+{
+#if SOC_LEDC_SUPPORT_HS_MODE
+  if (chan < LEDC_CHANS_PER_MODE)
+    return (LEDC_HIGH_SPEED_MODE);
+#endif
+  return (LEDC_LOW_SPEED_MODE);
+}
+
+ledc_channel_t LedcBackend::chanNo(int chan)
+{
+  return ((ledc_channel_t)(chan % LEDC_CHANS_PER_MODE));
+}
+
+
+/**
+ * @brief [INTERNAL] A channel's phase (counts) in LEDC_RES_BITS - where
+ *   its pulse starts
+ */
+uint32_t LedcBackend::hpoint(int chan)
+{
+#if LEDC_RES_BITS >= 12
+  return ((uint32_t)phase[chan] << (LEDC_RES_BITS - 12));
+#else
+  return ((uint32_t)phase[chan] >> (12 - LEDC_RES_BITS));
+#endif
+}
+
+
+/**
+ * @brief Start the LEDC timer(s), and every channel that has a pin.
+ *   (Channels start full off)
+ *
+ * @param freqHz - pwm frequency
+ */
+void LedcBackend::begin(uint32_t freqHz)
+{
+  freq = freqHz;
+  bool timerReady[2] = {false, false};
+  for (int chan = 0; chan < CHANNELS_PER_BOARD; chan++)
+  {
+    if (ledcPins[chan] < 0)
+      continue;
+    ledc_mode_t mode = chanMode(chan);
+    if (!timerReady[mode])
+    {
+      ledc_timer_config_t timerCfg = {};
+      timerCfg.speed_mode = mode;
+      timerCfg.duty_resolution = (ledc_timer_bit_t)LEDC_RES_BITS;
+      timerCfg.timer_num = LEDC_SERVO_TIMER;
+      timerCfg.freq_hz = freqHz;
+      timerCfg.clk_cfg = LEDC_AUTO_CLK;
+      if (ledc_timer_config(&timerCfg) != ESP_OK)
+        Serial.printf("LEDC: can't run %u bits at %u Hz\r\n", LEDC_RES_BITS, freqHz);
+      timerReady[mode] = true;
+    }
+
+    ledc_channel_config_t chanCfg = {};
+    chanCfg.gpio_num = ledcPins[chan];
+    chanCfg.speed_mode = mode;
+    chanCfg.channel = chanNo(chan);
+    chanCfg.intr_type = LEDC_INTR_DISABLE;
+    chanCfg.timer_sel = LEDC_SERVO_TIMER;
+    chanCfg.duty = 0;
+    chanCfg.hpoint = hpoint(chan);
+    ledc_channel_config(&chanCfg);
+  }
+#if LEDC_FADE_MS > 0
+  ledc_fade_func_install(0);
+#endif
+}
+
+
+/**
+ * @brief The pwm period (uSecs)
+ */
+uint32_t LedcBackend::periodUs()
+{
+  return (1000000 / freq);
+}
+
+
+/**
+ * @brief Set channels first..last. A burst is finished as soon as the
+ *   registers are written.  (Only the frame task writes)
+ *
+ * @param burst - the channels
+ * @param vals  - pwm value (fine counts) for each channel (indexed by channel)
+ */
+void LedcBackend::write(pwmBurst_t *burst, const int *vals)
+{
+  bool ok = true;
+  burst->queued = Stats::now();
+  for (int chan = burst->first; chan <= burst->last; chan++)
+  {
+    if (ledcPins[chan] < 0)
+      continue;
+    // fine counts (12 + PWM_FINE_BITS bits) -> LEDC_RES_BITS
+    uint32_t duty;
+    if (vals[chan] >= PWM_FULL_ON)
+      duty = 1 << LEDC_RES_BITS;     // full on
+    else if (vals[chan] <= 0)
+      duty = 0;
+    else
+#if LEDC_RES_BITS >= 12 + PWM_FINE_BITS
+      duty = (uint32_t)vals[chan] << (LEDC_RES_BITS - 12 - PWM_FINE_BITS);
+#else
+      duty = (uint32_t)vals[chan] >> (12 + PWM_FINE_BITS - LEDC_RES_BITS);
+#endif
+
+#if LEDC_FADE_MS > 0
+    // (a fade keeps the channel's hpoint)
+    if (ledc_set_fade_time_and_start(chanMode(chan), chanNo(chan), duty, LEDC_FADE_MS, LEDC_FADE_NO_WAIT) != ESP_OK)
+      ok = false;
+#else
+    if (ledc_set_duty_and_update(chanMode(chan), chanNo(chan), duty, hpoint(chan)) != ESP_OK)
+      ok = false;
+#endif
+  }
+  finished(burst, ok);
+}
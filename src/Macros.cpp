@@ -0,0 +1,486 @@
+/**
+ * @file Macros.cpp
+ * @author Doug Fajardo
+ * @brief  Record, save and replay sequences of commands.
+ * @version 0.1
+ * @date 2024-09-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Saved (flash) form of a macro:
+ *     <name> NUL <line> NUL <line> NUL ...
+ * It is re-recorded when loaded at boot, so the looked-up commands
+ * always match the running firmware.
+ */
+#include "Config.h"
+#include "Macros.h"
+#include "Prefs.h"
+
+/* STATIC DECLARATIONS */
+Macros::macro_t Macros::macros[MAX_MACROS];
+Commands *Macros::recorder = nullptr;
+int Macros::recSlot = -1;
+SemaphoreHandle_t Macros::macroLock = nullptr;
+
+// Argument schemas
+static const argSpec_t waitArgs[] = { {ARG_INT16, 0, INT16_MAX, "ms"} };
+
+// Macro commands (added to the command index by begin())
+const cmdList_t Macros::cmdList[] =
+{
+  {COMMENT,  " ",                                               1, 1, nullptr},
+  {COMMENT,  " - - - MACROS - - - - -",                         1, 1, nullptr},
+  {"macro",  "macro record|run|save|delete <name>  /  macro end|list", 2, 3, Macros::macroCmd, CMD_SLOW_VERB},
+  {"wait",   "wait <ms>  - pause (in a macro: ms after the previous wait) - holds up later commands", 2, 2, waitArgs, Macros::waitExec, OP_WAIT},
+  {"END",    "END",                                             0, 0, nullptr}  // end-of-list
+};
+
+
+/**
+ * @brief Run time setup - load any saved macros.
+ *   (Call after every module has added its commands - the
+ *    saved lines are looked up again as they are loaded)
+ */
+void Macros::begin()
+{
+  macroLock = xSemaphoreCreateMutex();
+  Commands::addCmdList(cmdList);
+  for (int slot = 0; slot < MAX_MACROS; slot++)
+  {
+    clear(slot, "");
+    load(slot);
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] Take (give back) the lock on the macro slots
+ */
+void Macros::lock()
+{
+  if (macroLock != nullptr)
+    xSemaphoreTake(macroLock, portMAX_DELAY);
+}
+
+void Macros::unlock()
+{
+  if (macroLock != nullptr)
+    xSemaphoreGive(macroLock);
+}
+
+
+/**
+ * @brief [INTERNAL] Find a macro by name
+ *
+ * @param name
+ * @return int - its slot, -1 if not found
+ */
+int Macros::find(const char *name)
+{
+  for (int slot = 0; slot < MAX_MACROS; slot++)
+  {
+    if ((macros[slot].name[0] != '\0') && (0 == strcasecmp(macros[slot].name, name)))
+      return (slot);
+  }
+  return (-1);
+}
+
+
+/**
+ * @brief [INTERNAL] Find an unused slot
+ *
+ * @return int - the slot, -1 if all are in use
+ */
+int Macros::findFree()
+{
+  for (int slot = 0; slot < MAX_MACROS; slot++)
+  {
+    if (macros[slot].name[0] == '\0')
+      return (slot);
+  }
+  return (-1);
+}
+
+
+/**
+ * @brief [INTERNAL] Empty a slot, and give it a name ("" frees it)
+ *   (A replay of what was there stops - see run())
+ *
+ * @param slot
+ * @param name
+ */
+void Macros::clear(int slot, const char *name)
+{
+  macro_t *mac = &macros[slot];
+  strncpy(mac->name, name, MACRO_NAME_LEN - 1);
+  mac->name[MACRO_NAME_LEN - 1] = '\0';
+  mac->complete = false;
+  mac->gen++;
+  mac->noOfSteps = 0;
+  mac->textLen = 0;
+}
+
+
+/**
+ * @brief Record a line (from the recording session) as the next step
+ *
+ * @param outStream - where to send the response
+ * @param tokCnt    - how many tokens?
+ * @param tokens    - list of tokens
+ */
+void Macros::record(Stream *outStream, int tokCnt, char **tokens)
+{
+  lock();
+  bool ok = (recSlot >= 0) && addStep(outStream, &macros[recSlot], tokCnt, tokens);
+  unlock();
+  if (ok)
+    outStream->println(OK_RESPONSE);
+}
+
+
+/**
+ * @brief [INTERNAL] Look up a line, decode its args, and add it to a macro.
+ *
+ * @param outStream - where to send error messages
+ * @param mac       - the macro
+ * @param tokCnt    - how many tokens?
+ * @param tokens    - list of tokens
+ * @return true     - step added
+ * @return false    - not added (error has been reported)
+ */
+bool Macros::addStep(Stream *outStream, macro_t *mac, int tokCnt, char **tokens)
+{
+  macroStep_t *step = &mac->steps[mac->noOfSteps];
+
+  if (mac->noOfSteps >= MACRO_MAX_STEPS)
+  {
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "macro: more than %d steps\r\n", MACRO_MAX_STEPS);
+#endif
+    outStream->println(ERR_RESPONSE);
+    return (false);
+  }
+
+  step->cmd = Commands::lookup(tokCnt, tokens);
+  if (step->cmd == nullptr)
+  {
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "macro: command '%s' not found\r\n", tokens[0]);
+#endif
+    outStream->println(ERR_RESPONSE);
+    return (false);
+  }
+
+  // A schema command is checked now. Unless it has a string arg (the
+  //   tokens don't outlive this line), its decoded args are kept.
+  step->decoded = false;
+  if (step->cmd->exec != nullptr)
+  {
+    if (!Commands::decodeArgs(outStream, step->cmd, tokCnt, tokens, &step->args))
+    {
+      outStream->println(ERR_RESPONSE);
+      return (false);
+    }
+    step->decoded = true;
+    for (int idx = 0; idx < step->args.argCnt; idx++)
+      step->decoded &= (step->cmd->argSpec[idx].type != ARG_STR);
+    step->args.tokens = nullptr;
+  }
+
+  // Keep the source line (re-quoting any token that needs it)
+  int len = mac->textLen;
+  for (int idx = 0; idx < tokCnt; idx++)
+  {
+    bool quote = (tokens[idx][0] == '\0') || (strpbrk(tokens[idx], SEPARATOR) != nullptr);
+    int room = MACRO_TEXT_LEN - len;
+    int used = snprintf(&mac->text[len], room, quote ? "%s\"%s\"" : "%s%s", (idx > 0) ? " " : "", tokens[idx]);
+    if (used >= room)
+    {
+#ifdef VERBOSE_RESPONSES
+      outStream->println("macro: too much text");
+#endif
+      outStream->println(ERR_RESPONSE);
+      return (false);
+    }
+    len += used;
+  }
+
+  step->textOfs = mac->textLen;
+  mac->textLen = len + 1;  // keep the NUL
+  mac->noOfSteps++;
+  return (true);
+}
+
+
+/**
+ * @brief [INTERNAL] Replay a macro. Each step is copied out under the
+ *   lock, then run without it - if the slot is cleared meanwhile
+ *   (deleted, or recorded again), we stop.
+ *
+ * @param outStream - where to send any output
+ * @param name      - the macro
+ * @return true     - every step worked
+ * @return false    - not found, a step failed, or it was deleted (we stop there)
+ */
+bool Macros::run(Stream *outStream, const char *name)
+{
+  macroStep_t step;
+  char line[CMD_BUF_LEN];
+  TickType_t lastWake = xTaskGetTickCount();
+
+  lock();
+  int slot = find(name);
+  bool ok = (slot >= 0) && macros[slot].complete;
+  uint32_t gen = ok ? macros[slot].gen : 0;
+  unlock();
+  if (!ok)
+  {
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "macro: '%s' not found (or still recording)\r\n", name);
+#endif
+    return (false);
+  }
+
+  macro_t *mac = &macros[slot];
+  for (int idx = 0; ; idx++)
+  {
+    lock();
+    bool gone = (mac->gen != gen);
+    bool done = gone || (idx >= mac->noOfSteps);
+    if (!done)
+    {
+      step = mac->steps[idx];
+      strncpy(line, &mac->text[step.textOfs], CMD_BUF_LEN - 1);
+      line[CMD_BUF_LEN - 1] = '\0';
+    }
+    unlock();
+    if (gone)
+    {
+#ifdef VERBOSE_RESPONSES
+      ResponseBuf::printTo(outStream, "macro: '%s' was deleted while running\r\n", name);
+#endif
+      return (false);
+    }
+    if (done)
+      return (true);
+
+    if (step.decoded)
+    {
+      if (step.cmd->exec == waitExec)
+      { // timed from the previous wait - not from now
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(step.args.val[0]));
+        continue;
+      }
+
+      if (!step.cmd->exec(outStream, &step.args))
+      {
+#ifdef VERBOSE_RESPONSES
+        ResponseBuf::printTo(outStream, "macro: step %d (%s) failed\r\n", idx + 1, line);
+#endif
+        return (false);
+      }
+    }
+    else
+    { // Text command - tokenize it again
+      char *tokens[MAX_ARGS];
+      int tokCnt = Tokenizer::tokenize(line, tokens, MAX_ARGS);
+      if (!Commands::run(outStream, step.cmd, tokCnt, tokens))
+        return (false);
+    }
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] Write a macro to flash
+ *
+ * @param slot
+ * @return true  - saved
+ * @return false - flash error
+ */
+bool Macros::save(int slot)
+{
+  macro_t *mac = &macros[slot];
+  char buf[MACRO_NAME_LEN + MACRO_TEXT_LEN];
+  size_t nameLen = strlen(mac->name) + 1;
+
+  memcpy(buf, mac->name, nameLen);
+  memcpy(&buf[nameLen], mac->text, mac->textLen);
+  return (Prefs::putMacro(slot, buf, nameLen + mac->textLen));
+}
+
+
+/**
+ * @brief [INTERNAL] Read a macro from flash (if any), and record it again.
+ *
+ * @param slot
+ */
+void Macros::load(int slot)
+{
+  char buf[MACRO_NAME_LEN + MACRO_TEXT_LEN];
+  size_t len = Prefs::getMacro(slot, buf, sizeof(buf));
+  if ((len == 0) || (buf[len - 1] != '\0'))
+    return;
+
+  clear(slot, buf);
+  for (size_t pos = strlen(buf) + 1; pos < len; pos += strlen(&buf[pos]) + 1)
+  {
+    char *tokens[MAX_ARGS];
+    int tokCnt = Tokenizer::tokenize(&buf[pos], tokens, MAX_ARGS);
+    if (tokCnt == 0)
+      continue;
+    if (!addStep(&Serial, &macros[slot], tokCnt, tokens))
+    {
+      Serial.printf("Macros: could not load '%s'\r\n", macros[slot].name);
+      clear(slot, "");
+      return;
+    }
+  }
+  macros[slot].complete = true;
+}
+
+
+/**
+ * @brief The 'macro' command
+ *    macro record|run|save|delete <name>
+ *    macro end|list
+ *
+ * @param outStream - where to send the response
+ * @param tokCnt    - how many tokens?
+ * @param tokens    - list of tokens
+ */
+void Macros::macroCmd(Stream *outStream, int tokCnt, char **tokens)
+{
+  const char *op = tokens[1];
+  const char *name = (tokCnt == 3) ? tokens[2] : nullptr;
+  bool ok;
+
+  if ((name != nullptr) && (0 == strcasecmp(op, "run")))
+    ok = run(outStream, name);   // (locks for each step)
+  else
+  {
+    lock();
+    ok = edit(outStream, op, name);
+    unlock();
+  }
+  outStream->println(ok ? OK_RESPONSE : ERR_RESPONSE);
+}
+
+
+/**
+ * @brief [INTERNAL] Every 'macro' op but run. (Caller holds the lock)
+ *   Flash is written under the lock, too, so a save and a delete of
+ *   the same slot (from two sessions) can't cross.
+ *
+ * @param outStream - where to send any text
+ * @param op        - record|save|delete|end|list
+ * @param name      - the macro (nullptr for end|list)
+ * @return true     - it worked
+ */
+bool Macros::edit(Stream *outStream, const char *op, const char *name)
+{
+  int slot = (name != nullptr) ? find(name) : -1;
+
+  if ((name == nullptr) && (0 == strcasecmp(op, "end")))
+  {
+    if (!isRecording(Commands::current()))
+    {
+#ifdef VERBOSE_RESPONSES
+      outStream->println("macro: not recording");
+#endif
+      return (false);
+    }
+    macros[recSlot].complete = true;
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "macro '%s' has %d steps\r\n", macros[recSlot].name, macros[recSlot].noOfSteps);
+#endif
+    recorder = nullptr;
+    recSlot = -1;
+  }
+
+  else if ((name == nullptr) && (0 == strcasecmp(op, "list")))
+  {
+    for (slot = 0; slot < MAX_MACROS; slot++)
+    {
+      if (macros[slot].name[0] != '\0')
+        ResponseBuf::printTo(outStream, "%-*s %2d steps%s\r\n", MACRO_NAME_LEN, macros[slot].name, macros[slot].noOfSteps,
+                                        macros[slot].complete ? "" : " (recording)");
+    }
+  }
+
+  else if ((name != nullptr) && (0 == strcasecmp(op, "record")))
+  {
+    if (recorder != nullptr)
+    {
+#ifdef VERBOSE_RESPONSES
+      ResponseBuf::printTo(outStream, "macro: already recording '%s'\r\n", macros[recSlot].name);
+#endif
+      return (false);
+    }
+    if (slot < 0) slot = findFree();
+    if ((slot < 0) || (strlen(name) >= MACRO_NAME_LEN))
+    {
+#ifdef VERBOSE_RESPONSES
+      outStream->println("macro: no free slot (or name too long)");
+#endif
+      return (false);
+    }
+    clear(slot, name);
+    recSlot = slot;
+    recorder = Commands::current();
+  }
+
+  else if ((name != nullptr) && (slot < 0))
+  {
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "macro: '%s' not found\r\n", name);
+#endif
+    return (false);
+  }
+
+  else if ((name != nullptr) && (0 == strcasecmp(op, "save")))
+  {
+    if (!macros[slot].complete || !save(slot))
+    {
+#ifdef VERBOSE_RESPONSES
+      outStream->println("macro: save failed");
+#endif
+      return (false);
+    }
+  }
+
+  else if ((name != nullptr) && (0 == strcasecmp(op, "delete")))
+  {
+    if (slot == recSlot)
+    {
+      recorder = nullptr;
+      recSlot = -1;
+    }
+    clear(slot, "");
+    Prefs::removeMacro(slot);
+  }
+
+  else
+  {
+#ifdef VERBOSE_RESPONSES
+    outStream->println("macro: expected record|run|save|delete <name>, or end|list");
+#endif
+    return (false);
+  }
+  return (true);
+}
+
+
+/**
+ * @brief Pause  (wait <ms>)
+ *   (In a macro, the pause is timed by run() instead)
+ * 
+ * @param outStream - where to send the response
+ * @param args      - val[0] is the pause in ms (range checked by the dispatcher)
+ * @return true     - always
+ */
+bool Macros::waitExec(Stream *outStream, const cmdArgs_t *args)
+{
+  vTaskDelay(pdMS_TO_TICKS(args->val[0]));
+  return (true);
+}
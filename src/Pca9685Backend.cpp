@@ -0,0 +1,110 @@
+/**
+ * @file Pca9685Backend.cpp
+ * @author Doug Fajardo
+ * @brief  PWM backend: an HW716 (PCA9685) board on the I2C bus
+ * @version 0.1
+ * @date 2024-09-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Config.h"
+#include "Pca9685Backend.h"
+#include <Wire.h>
+
+
+Pca9685Backend::Pca9685Backend(int board, uint8_t i2cAddr)
+    : driver(i2cAddr), boardNo(board), addr(i2cAddr)
+{
+}
+
+
+/**
+ * @brief Start the board (and the I2C bus task)
+ *
+ * @param freqHz - pwm frequency
+ */
+void Pca9685Backend::begin(uint32_t freqHz)
+{
+  driver.begin();
+  // driver.setOscillatorFrequency(27000000); IF we need to trim HW716 osc freq
+  driver.setPWMFreq(freqHz);
+
+  // Register auto-increment ON (setPWMFreq sets it too - but don't depend on it)
+  Wire.beginTransmission(addr);
+  Wire.write(PCA9685_MODE1);
+  Wire.write(MODE1_AI | MODE1_ALLCAL);
+  Wire.endTransmission();
+
+  I2cBus::begin(SERVO_I2C_CLOCK);   // (from here on, writes are queued)
+}
+
+
+/**
+ * @brief The board's pwm period:  (prescale+1) * 4096 / osc
+ */
+uint32_t Pca9685Backend::periodUs()
+{
+  return (((uint64_t)driver.readPrescale() + 1) * 4096 * 1000000ULL / driver.getOscillatorFrequency());
+}
+
+
+/**
+ * @brief Queue channels first..last as ONE I2C write: the start
+ *   register (LEDn_ON_L), then 4 bytes (ON_L ON_H OFF_L OFF_H) per
+ *   channel. Values are rounded to whole counts. A pulse goes on at the
+ *   channel's phase, and off 'width' counts later (the chip wraps an 
+ *   OFF count below the ON count into the next period). 0 is full off,
+ *   4095+ is full on - as Adafruit's setPin() does.
+ *   (Only the frame task writes)
+ *
+ * @param burst - the channels
+ * @param vals  - pwm value (fine counts) for each channel (indexed by channel)
+ */
+void Pca9685Backend::write(pwmBurst_t *burst, const int *vals)
+{
+  static i2cXfer_t xfer;   // (submit copies it)
+  uint8_t *dst = xfer.data;
+  *dst++ = PCA9685_LED0_ON_L + 4 * burst->first;
+  for (int chan = burst->first; chan <= burst->last; chan++)
+  {
+    int pwmVal = (vals[chan] + (1 << (PWM_FINE_BITS - 1))) >> PWM_FINE_BITS;
+    uint16_t on = phase[chan];
+    uint16_t off = (phase[chan] + pwmVal) & 4095;
+    if (pwmVal >= 4095)
+    {   on = 4096;  off = 0;   }    // full on
+    else if (pwmVal <= 0)
+    {   on = 0;     off = 4096; }   // full off
+
+    *dst++ = on & 0xff;
+    *dst++ = on >> 8;
+    *dst++ = off & 0xff;
+    *dst++ = off >> 8;
+  }
+  xfer.addr = addr;
+  xfer.len = dst - xfer.data;
+  xfer.done = xferDone;
+  xfer.tag = (boardNo << 16) | (burst->first << 8) | burst->last;
+  xfer.stamp = burst->stamp;
+
+  if (!I2cBus::submit(&xfer))
+  {
+    burst->queued = xfer.queued;
+    finished(burst, false);
+  }
+}
+
+
+/**
+ * @brief [INTERNAL] A write finished (on the I2C bus task)
+ */
+void Pca9685Backend::xferDone(const i2cXfer_t *xfer, bool ok)
+{
+  pwmBurst_t burst;
+  burst.board = xfer->tag >> 16;
+  burst.first = (xfer->tag >> 8) & 0xff;
+  burst.last = xfer->tag & 0xff;
+  burst.stamp = xfer->stamp;
+  burst.queued = xfer->queued;
+  finished(&burst, ok);
+}
@@ -9,6 +9,7 @@
 Preferences *Prefs::preferences;
 
 bool Prefs::alreadyInited = false; // flag -prevent multiple inits
+SemaphoreHandle_t Prefs::prefLock = nullptr;
 
 // Each parameter has storage AND has a 'changed' flag
 int Prefs::versionNo = 0;
@@ -26,7 +27,40 @@ bool Prefs::name_changed = false;
 uint32_t Prefs::pref_portno = -1;
 bool Prefs::portno_changed = false;
 
+uint32_t Prefs::pref_baud = BAUD_DEF;
+bool Prefs::baud_changed = false;
+
+uint32_t Prefs::pref_budget = DEF_CURRENT_BUDGET_MA;
+bool Prefs::budget_changed = false;
+
+Prefs::geometry_t Prefs::pref_geometry = { NOD_BASE_DEF, TILT_BASE_DEF, ARM_LEN_DEF };
+bool Prefs::geometry_changed = false;
+
 Prefs::ServoLimits_t Prefs::servoLimits[NO_OF_SERVOS];
+uint32_t Prefs::limitsVersion = 0;
+
+uint16_t Prefs::boardRefresh[NO_OF_BOARDS];
+bool Prefs::refresh_changed = false;
+
+// Argument schemas
+static const argSpec_t ssidArgs[]  = { {ARG_STR,   0, 0,                          "ssid"} };
+static const argSpec_t passArgs[]  = { {ARG_STR,   0, 0,                          "password"} };
+static const argSpec_t alexaArgs[] = { {ARG_STR,   0, 0,                          "alexa name"} };
+static const argSpec_t udpArgs[]   = { {ARG_INT32, 1, 65535,                      "port number"} };
+static const argSpec_t baudArgs[]  = { {ARG_INT32, SERIAL_MIN_BAUD, SERIAL_MAX_BAUD, "baud rate"} };
+
+// Network config commands (added to the command index by setup())
+const cmdList_t Prefs::cmdList[] =
+{
+  {COMMENT,  " ",                                  1, 1,           nullptr},
+  {COMMENT, " - - - Network Config - - - - -",     1, 1,           nullptr},
+  {"ssid",   "ssid  <name> - set the WiFi ssid",   2, 2,           ssidArgs,  Prefs::pref_ssid_exec},
+  {"pass",   "pass <pwd>  - set the WiFi passwd",  2, 2,           passArgs,  Prefs::pref_pass_exec},
+  {"Alexa",  "alexa <name> - set the alexa name",  2, 2,           alexaArgs, Prefs::pref_alexa_exec},
+  {"udp",    "udp  <portno> - set the UDP/telnet port number", 2,2, udpArgs,  Prefs::prefUdpPort_exec},
+  {"baud",   "baud [<rate>] - get/set the serial baud rate (after reboot)", 1,2, baudArgs, Prefs::prefBaud_exec},
+  {"END",    "END",                                0, 0,           nullptr}  // end-of-list
+};
 
 #define VERSION_NO_KEY  "version"
 
@@ -36,12 +70,13 @@ Prefs::ServoLimits_t Prefs::servoLimits[NO_OF_SERVOS];
 #define PASS_KEY     "pass"
 #define NAME_KEY     "name"
 #define PORTNO_KEY   "port"
-#define JAW_KEY      "jaw"
-#define ROT_KEY      "rotate"
-#define LEFT_KEY     "left"
-#define RIGHT_KEY    "right"
-#define LEYE_KEY     "left"
-#define REYE_KEY     "right"
+#define BAUD_KEY     "baud"
+#define BUDGET_KEY   "budget"
+#define GEOMETRY_KEY "geom"
+#define MACRO_KEY    "mac%d"     // one per macro slot
+#define SERVO_KEY    "sv_%s"     // one per servo (by name)
+#define WEAR_KEY     "wr_%s"     // one per servo (by name)
+#define REFRESH_KEY  "bd%d_hz"   // one per board
 
 // Initializer - only do once!
 Prefs::Prefs() {
@@ -52,24 +87,6 @@ Prefs::~Prefs() {
   //
 }
 
-/**
- * @brief Print a string left justified in a fixed-width field
- *    (padd it with trailing spaces)
- * 
- * @param outStream - the output device
- * @param s         - the string
- * @param width     - how wide is the field?
- */
-void Prefs::pad(Stream *outStream, String s, int width)
-  {
-    int l=s.length();
-    outStream->print(s);
-    for (int idx=0; idx<width-l; idx++)
-    {
-      outStream->print(" ");
-    }
-  }
-
 /**
  * @brief Command to dump current prefrences
  * 
@@ -79,25 +96,35 @@ void Prefs::pad(Stream *outStream, String s, int width)
  */
 void Prefs::dump_cmd(Stream *outStream, int tokCnt, char **tokens)
 {
-  bool changeFlag= (versionChanged || ssid_changed || pass_changed || name_changed || portno_changed);
-  outStream->print("Flash Version: "); outStream->println(versionNo);
-  outStream->print("SSID:          "); outStream->println(pref_ssid);
-  outStream->print("PASS:          "); outStream->println(pref_pass);
-  outStream->print("Alexa Name:    "); outStream->println(pref_name);
-  outStream->print("UDP Port:      "); outStream->println(pref_portno);
+  lock();
+  bool changeFlag= (versionChanged || ssid_changed || pass_changed || name_changed || portno_changed || baud_changed ||
+                    refresh_changed || budget_changed || geometry_changed);
+  ResponseBuf::printTo(outStream, "Flash Version: %d\r\n", versionNo);
+  ResponseBuf::printTo(outStream, "SSID:          %s\r\n", pref_ssid.c_str());
+  ResponseBuf::printTo(outStream, "PASS:          %s\r\n", pref_pass.c_str());
+  ResponseBuf::printTo(outStream, "Alexa Name:    %s\r\n", pref_name.c_str());
+  ResponseBuf::printTo(outStream, "UDP Port:      %u\r\n", pref_portno);
+  ResponseBuf::printTo(outStream, "Serial Baud:   %u\r\n", pref_baud);
+  ResponseBuf::printTo(outStream, "Servo budget:  %u mA\r\n", pref_budget);
+  ResponseBuf::printTo(outStream, "Head geometry: nod base %d  tilt base %d  arm %d mm\r\n",
+                                  pref_geometry.nodBase, pref_geometry.tiltBase, pref_geometry.armLen);
+  for (int board = 0; board < NO_OF_BOARDS; board++)
+    ResponseBuf::printTo(outStream, "Board %d:       %s  %d Hz\r\n", board,
+                                    (servoBoards[board].type == PWM_LEDC) ? "LEDC   " : "PCA9685", boardRefresh[board]);
 
   for (int id=0; id<NO_OF_SERVOS; id++)
   {
     changeFlag |= servoLimits[id].limits_changed;
-    outStream->print("Servo no ");outStream->print(id);
-    
-    outStream->print(" (");  pad(outStream, ServoToName( id)+")", 7);
-    outStream->print(" PWM: "); outStream->print(servoLimits[id].minimum);
-    outStream->print("  To  "); outStream->print(servoLimits[id].maximum);
-
-    outStream->print(" angle: "); outStream->print(servoLimits[id].minAngle) ;
-    outStream->print(" To  ");outStream->print(servoLimits[id].maxAngle); outStream->println(" Degrees);");
+    ResponseBuf::printTo(outStream, "Servo no %d (%-6s PWM: %d  To  %d angle: %d To  %d Degrees deadband: %d);\r\n",
+                                    id, (ServoToName(id) + ")").c_str(),
+                                    servoLimits[id].minimum, servoLimits[id].maximum,
+                                    servoLimits[id].minAngle, servoLimits[id].maxAngle, servoLimits[id].deadband);
+    ResponseBuf::printTo(outStream, "      motion: %d deg/s  %d deg/s/s  jerk %d deg/s/s/s  idle: %d secs\r\n",
+                                    servoLimits[id].maxVel, servoLimits[id].maxAccel, servoLimits[id].maxJerk, servoLimits[id].idleSecs);
+    for (int idx = 0; idx < servoLimits[id].calCount; idx++)
+      ResponseBuf::printTo(outStream, "      cal point: %4d Degrees  PWM: %d\r\n", servoLimits[id].cal[idx].angle, servoLimits[id].cal[idx].pwm);
   }
+  unlock();
 
   outStream->print("There are "); outStream->print( (changeFlag)?"": "NO"); outStream->println(" changes pending");
   outStream->println(OK_RESPONSE);
@@ -140,26 +167,28 @@ void Prefs::reset_flash_cmd(Stream *outStream, int tokCnt, char **tokens)
  * DONT forget to COMMIT your change!
  * 
  * @param outStream - where to send the result
- * @param tokCnt    - how many tokens? 1 means get it, 2 means set it
- * @param tokens    - list of tokens
+ * @param args      - 1 arg means set it
+ * @return true     - always
  */
-void Prefs::pref_ssid_cmd(Stream *outStream, int tokCnt, char **tokens)
+bool Prefs::pref_ssid_exec(Stream *outStream, const cmdArgs_t *args)
 {
-  if (tokCnt == 2)
+  lock();
+  if (args->argCnt == 1)
   {
-    pref_ssid = tokens[1];
+    pref_ssid = args->tokens[1];
     ssid_changed = true;
   }
 
 #ifdef VERBOSE_RESPONSES
   outStream->print("SSID: ");
   outStream->print(pref_ssid);
-  if (tokCnt == 2)
+  if (args->argCnt == 1)
     outStream->print("CHANGED");
   else
     outStream->println(" ");
 #endif
-  outStream->println(OK_RESPONSE);
+  unlock();
+  return (true);
 }
 
 
@@ -167,25 +196,27 @@ void Prefs::pref_ssid_cmd(Stream *outStream, int tokCnt, char **tokens)
  * @brief command to get (or set) the wifi password 
  * 
  * @param outStream - where to send the result
- * @param tokCnt    - how many tokens? 1 means get it, 2 means set it
- * @param tokens    - list of tokens
+ * @param args      - 1 arg means set it
+ * @return true     - always
  */
-void Prefs::pref_pass_cmd(Stream *outStream, int tokCnt, char **tokens)
+bool Prefs::pref_pass_exec(Stream *outStream, const cmdArgs_t *args)
 {
-  if (tokCnt==2)
+  lock();
+  if (args->argCnt == 1)
   {
-    pref_pass=tokens[1];
+    pref_pass = args->tokens[1];
     pass_changed=true;
   }
 #ifdef VERBOSE_RESPONSES
     outStream->print("Password: "); outStream->print(pref_pass); 
-    if (tokCnt==2) 
+    if (args->argCnt == 1) 
       outStream->println(" changed");
     else
       outStream->println(" ");
   outStream->print("Password: "); outStream->println(pref_pass);
 #endif
-  outStream->println(OK_RESPONSE);
+  unlock();
+  return (true);
 }
 
 
@@ -193,26 +224,28 @@ void Prefs::pref_pass_cmd(Stream *outStream, int tokCnt, char **tokens)
  * @brief command to get (or set) Alexa's name for this device
  * 
  * @param outStream - where to send the result
- * @param tokCnt    - how many tokens? 1 means get it, 2 means set it
- * @param tokens    - list of tokens
+ * @param args      - 1 arg means set it
+ * @return true     - always
  */
-void Prefs::pref_alexa_cmd(Stream *outStream, int tokCnt, char **tokens)
+bool Prefs::pref_alexa_exec(Stream *outStream, const cmdArgs_t *args)
 {
-  if (tokCnt==2)
+  lock();
+  if (args->argCnt == 1)
   {
-    pref_name = tokens[1];
+    pref_name = args->tokens[1];
     name_changed=true;
   }
   #ifdef VERBOSE_RESPONSES
     outStream->print("Alexa name: "); outStream->print(pref_name); 
-    if (tokCnt==2) 
+    if (args->argCnt == 1) 
     { 
       outStream->println(" changed");
     } else {
       outStream->println(" ");
     }
   #endif
-  outStream->println(OK_RESPONSE);
+  unlock();
+  return (true);
 }
 
 
@@ -220,37 +253,55 @@ void Prefs::pref_alexa_cmd(Stream *outStream, int tokCnt, char **tokens)
  * @brief command to get (or set) the UDP port number
  * 
  * @param outStream - where to send the result
- * @param tokCnt    - how many tokens? 1 means get it, 2 means set it
- * @param tokens    - list of tokens
+ * @param args      - 1 arg means set it (range checked by the dispatcher)
+ * @return true     - always
  */
-void Prefs::prefUdpPort_cmd(Stream *outStream, int tokCnt, char **tokens)
+bool Prefs::prefUdpPort_exec(Stream *outStream, const cmdArgs_t *args)
 {
-  if (tokCnt == 2)
+  if (args->argCnt == 1)
   {
-    errno = 0;
-    long newport = strtol(tokens[1], nullptr, 10);
-    if ((errno != 0) || (newport <= 0) || (newport > 65536))
-    {
-#ifdef VERBOSE_RESPONSES
-      outStream->println(" Argument is not a valid port number ");
-#endif
-      outStream->println(ERR_RESPONSE);
-      return;
-    }
-    pref_portno = newport;
+    lock();
+    pref_portno = args->val[0];
     portno_changed = true;
+    unlock();
   }
 #ifdef VERBOSE_RESPONSES
   outStream->print("UDP_PORT: ");
   outStream->println(pref_portno);
-  if (tokCnt == 2)
+  if (args->argCnt == 1)
     outStream->println(" changed");
   else
     outStream->println(" ");
 #endif
-  outStream->println(OK_RESPONSE);
+  return (true);
+}
+
+
+/**
+ * @brief command to get (or set) the serial port baud rate
+ *   NOTE: The new rate is used after the next reboot
+ *   (DONT forget to COMMIT your change!)
+ * 
+ * @param outStream - where to send the result
+ * @param args      - 1 arg means set it (range checked by the dispatcher)
+ * @return true     - always
+ */
+bool Prefs::prefBaud_exec(Stream *outStream, const cmdArgs_t *args)
+{
+  if (args->argCnt == 1)
+  {
+    lock();
+    pref_baud = args->val[0];
+    baud_changed = true;
+    unlock();
+  }
+#ifdef VERBOSE_RESPONSES
+  ResponseBuf::printTo(outStream, "BAUD: %u%s\r\n", pref_baud, (args->argCnt == 1) ? " changed (commit, then reboot)" : "");
+#endif
+  return (true);
 }
 
+
 /**
  * @brief We only want this ONCE!
  * 
@@ -260,6 +311,7 @@ void Prefs::setup()
   if (alreadyInited)   return;
   alreadyInited = true;
 
+  prefLock = xSemaphoreCreateMutex();
   preferences = new Preferences();
 
   if (!preferences->begin("Curtains24", false, NULL))
@@ -271,6 +323,7 @@ void Prefs::setup()
     Serial.println("Preferences.begin was successful");
   }
   readAllValues(false);
+  Commands::addCmdList(cmdList);
 }
 
 
@@ -282,6 +335,7 @@ void Prefs::setup()
  */
 void Prefs::readAllValues(bool forceFlag)
 {
+  lock();
   versionNo = preferences->getInt(VERSION_NO_KEY, -1);
   Serial.print("In readAllValues: cur_version="); Serial.println(versionNo);
   if (forceFlag || (versionNo != FLASH_VERSION_NO))
@@ -341,86 +395,87 @@ void Prefs::readAllValues(bool forceFlag)
     portno_changed = false;
   }
 
-  // Assume no changes to servos (Yea, I'm an optimist)
-  for (int i=0; i<NO_OF_SERVOS; i++)
+  // --- Serial baud rate
+  pref_baud = preferences->getUInt(BAUD_KEY, 0);
+  if (versionChanged || (pref_baud == 0))
   {
-    servoLimits[i].limits_changed=false;
+    pref_baud = BAUD_DEF;
+    baud_changed = true;
+  }
+  else
+  {
+    baud_changed = false;
   }
 
-  // - - - - JAW
-  int res;
-  res = preferences->getBytes(JAW_KEY, &servoLimits[JAW_SERVO], sizeof(ServoLimits_t));
-
-  if (versionChanged || (res == 0))
-    {
-      servoLimits[JAW_SERVO].minimum = DEF_JAW_MIN;
-      servoLimits[JAW_SERVO].maximum = DEF_JAW_MAX;
-      servoLimits[JAW_SERVO].minAngle = DEF_JAW_ANGMIN;
-      servoLimits[JAW_SERVO].maxAngle = DEF_JAW_ANGMAX;
-      servoLimits[JAW_SERVO].limits_changed = true;
-    }
-
-  // - - - - ROTATE
-  res = preferences->getBytes(ROT_KEY, &servoLimits[ROT_SERVO], sizeof(ServoLimits_t));
-
-  if (versionChanged || (res == 0))
-    {
-      servoLimits[ROT_SERVO].minimum = DEF_ROT_MIN;
-      servoLimits[ROT_SERVO].maximum = DEF_ROT_MAX;
-      servoLimits[ROT_SERVO].minAngle = DEF_ROT_ANGMIN;
-      servoLimits[ROT_SERVO].maxAngle = DEF_ROT_ANGMAX;
-      servoLimits[ROT_SERVO].limits_changed = true;
-    }
-
-    // - - - - LEFT
-  res = preferences->getBytes(LEFT_KEY, &servoLimits[LEFT_SERVO], sizeof(ServoLimits_t));
-
-  if (versionChanged || (res == 0))
-    {
-      servoLimits[LEFT_SERVO].minimum = DEF_LEFT_MIN;
-      servoLimits[LEFT_SERVO].maximum = DEF_LEFT_MAX;
-      servoLimits[LEFT_SERVO].minAngle = DEF_LEFT_ANGMIN;
-      servoLimits[LEFT_SERVO].maxAngle = DEF_LEFT_ANGMAX;
-      servoLimits[LEFT_SERVO].limits_changed = true;
-    }
-
-
-    // - - - - RIGHT
-  res = preferences->getBytes(RIGHT_KEY, &servoLimits[RIGHT_SERVO], sizeof(ServoLimits_t));
-
-  if (versionChanged || (res == 0))
-    {
-      servoLimits[RIGHT_SERVO].minimum = DEF_RIGHT_MIN;
-      servoLimits[RIGHT_SERVO].maximum = DEF_RIGHT_MAX;
-      servoLimits[RIGHT_SERVO].minAngle = DEF_RIGHT_ANGMIN;
-      servoLimits[RIGHT_SERVO].maxAngle = DEF_RIGHT_ANGMAX;      
-      servoLimits[RIGHT_SERVO].limits_changed = true;
-    }
-
+  // --- Servo current budget (0 is valid - no limit)
+  if (versionChanged || !preferences->isKey(BUDGET_KEY))
+  {
+    pref_budget = DEF_CURRENT_BUDGET_MA;
+    budget_changed = true;
+  }
+  else
+  {
+    pref_budget = preferences->getUInt(BUDGET_KEY, DEF_CURRENT_BUDGET_MA);
+    budget_changed = false;
+  }
 
-    // - - - - LEYE
-  res = preferences->getBytes(LEFT_KEY, &servoLimits[LEYE_SERVO], sizeof(ServoLimits_t));
+  // --- Head geometry
+  if (versionChanged || (preferences->getBytes(GEOMETRY_KEY, &pref_geometry, sizeof(geometry_t)) != sizeof(geometry_t)))
+  {
+    pref_geometry.nodBase = NOD_BASE_DEF;
+    pref_geometry.tiltBase = TILT_BASE_DEF;
+    pref_geometry.armLen = ARM_LEN_DEF;
+    geometry_changed = true;
+  }
+  else
+  {
+    geometry_changed = false;
+  }
 
-  if (versionChanged || (res == 0))
+  // --- Board refresh rates
+  refresh_changed = false;
+  for (int board = 0; board < NO_OF_BOARDS; board++)
+  {
+    char key[16];
+    snprintf(key, sizeof(key), REFRESH_KEY, board);
+    boardRefresh[board] = preferences->getUShort(key, 0);
+    if (versionChanged || (boardRefresh[board] == 0))
     {
-      servoLimits[LEYE_SERVO].minimum = DEF_LEYE_MIN;
-      servoLimits[LEYE_SERVO].maximum = DEF_LEYE_MAX;
-      servoLimits[LEYE_SERVO].minAngle= DEF_LEYE_ANGMIN;
-      servoLimits[LEYE_SERVO].maxAngle= DEF_LEYE_ANGMAX;        
-      servoLimits[LEYE_SERVO].limits_changed = true;
+      boardRefresh[board] = servoBoards[board].freqHz;
+      refresh_changed = true;
     }
+  }
 
+  // Assume no changes to servos (Yea, I'm an optimist)
+  for (int i=0; i<NO_OF_SERVOS; i++)
+  {
+    servoLimits[i].limits_changed=false;
+  }
 
-    // - - - - REYE
-  res = preferences->getBytes(REYE_KEY, &servoLimits[REYE_SERVO], sizeof(ServoLimits_t));
-  if (versionChanged || (res == 0))
+  // - - - - SERVOS (keyed by name)
+  for (int id = 0; id < NO_OF_SERVOS; id++)
+  {
+    const servoDesc_t *desc = &servoTable[id];
+    char key[16];
+    snprintf(key, sizeof(key), SERVO_KEY, desc->name);
+    int res = preferences->getBytes(key, &servoLimits[id], sizeof(ServoLimits_t));
+    if (versionChanged || (res == 0))
     {
-      servoLimits[REYE_SERVO].minimum = DEF_REYE_MIN;
-      servoLimits[REYE_SERVO].maximum = DEF_REYE_MAX;
-      servoLimits[REYE_SERVO].minAngle = DEF_REYE_ANGMIN;
-      servoLimits[REYE_SERVO].maxAngle = DEF_REYE_ANGMAX;  
-      servoLimits[REYE_SERVO].limits_changed = true;
+      servoLimits[id].minimum = desc->minPwm;
+      servoLimits[id].maximum = desc->maxPwm;
+      servoLimits[id].minAngle = desc->minAngle;
+      servoLimits[id].maxAngle = desc->maxAngle;
+      servoLimits[id].deadband = DEF_DEADBAND;
+      servoLimits[id].maxVel = desc->maxVel;
+      servoLimits[id].maxAccel = desc->maxAccel;
+      servoLimits[id].maxJerk = DEF_JERK;
+      servoLimits[id].idleSecs = DEF_IDLE_SECS;
+      servoLimits[id].calCount = 0;
+      servoLimits[id].limits_changed = true;
     }
+  }
+    limitsVersion++;
+    unlock();
     commit();
   }
 
@@ -432,78 +487,110 @@ void Prefs::commit()
 {
   Serial.println("IN COMMIT:"); Serial.print("VersionChange flag is "); Serial.print(versionChanged);
   Serial.print(" VERSION is ");Serial.println(versionNo);
-  if (versionChanged)
-  {
-  preferences->putInt(VERSION_KEY, versionNo);
-  versionChanged = false;
-  }
 
-  if (ssid_changed)
-  {
-  preferences->putString(SSID_KEY, pref_ssid);
-  ssid_changed = false;
-  }
+  // Each changed value is copied (and its flag cleared) under the lock,
+  //   then written. A set that lands meanwhile is saved next time.
+  String str;
+  int num;
+  uint32_t unum;
+  geometry_t geom;
+  uint16_t refresh[NO_OF_BOARDS];
+  ServoLimits_t limits;
 
-  if (pass_changed)
-  {
-  preferences->putString(PASS_KEY, pref_pass);
-  pass_changed = false;
-  }
+  if (takeChange(&versionChanged, &versionNo, &num, sizeof(num)))
+    preferences->putInt(VERSION_KEY, num);
 
-  if (name_changed)
-  {
-  preferences->putString(NAME_KEY, pref_name);
-  name_changed = false;
-  }
+  if (takeChange(&ssid_changed, &pref_ssid, &str))
+    preferences->putString(SSID_KEY, str);
 
-  if (portno_changed)
-  {
-  preferences->putLong( PORTNO_KEY, pref_portno);
-  portno_changed = false;
-  }
+  if (takeChange(&pass_changed, &pref_pass, &str))
+    preferences->putString(PASS_KEY, str);
 
-  if (servoLimits[JAW_SERVO].limits_changed)
-  {
-    preferences->putBytes(JAW_KEY, &servoLimits[JAW_SERVO], sizeof(ServoLimits_t));
-    servoLimits[JAW_SERVO].limits_changed=false;
-  }
+  if (takeChange(&name_changed, &pref_name, &str))
+    preferences->putString(NAME_KEY, str);
 
+  if (takeChange(&portno_changed, &pref_portno, &unum, sizeof(unum)))
+    preferences->putLong( PORTNO_KEY, unum);
 
-  if (servoLimits[ROT_SERVO].limits_changed)
-  {
-    preferences->putBytes(ROT_KEY, &servoLimits[ROT_SERVO], sizeof(ServoLimits_t));
-    servoLimits[ROT_SERVO].limits_changed=false;
-  }
+  if (takeChange(&baud_changed, &pref_baud, &unum, sizeof(unum)))
+    preferences->putUInt(BAUD_KEY, unum);
 
+  if (takeChange(&budget_changed, &pref_budget, &unum, sizeof(unum)))
+    preferences->putUInt(BUDGET_KEY, unum);
 
-  if (servoLimits[LEFT_SERVO].limits_changed)
+  if (takeChange(&geometry_changed, &pref_geometry, &geom, sizeof(geom)))
+    preferences->putBytes(GEOMETRY_KEY, &geom, sizeof(geometry_t));
+
+  if (takeChange(&refresh_changed, boardRefresh, refresh, sizeof(refresh)))
   {
-    preferences->putBytes(LEFT_KEY, &servoLimits[LEFT_SERVO], sizeof(ServoLimits_t));
-    servoLimits[LEFT_SERVO].limits_changed=false;
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+      char key[16];
+      snprintf(key, sizeof(key), REFRESH_KEY, board);
+      preferences->putUShort(key, refresh[board]);
+    }
   }
 
-
-  if (servoLimits[RIGHT_SERVO].limits_changed)
+  for (int id = 0; id < NO_OF_SERVOS; id++)
   {
-    preferences->putBytes(RIGHT_KEY, &servoLimits[RIGHT_SERVO], sizeof(ServoLimits_t));
-    servoLimits[RIGHT_SERVO].limits_changed=false;
+    if (!takeChange(&servoLimits[id].limits_changed, &servoLimits[id], &limits, sizeof(ServoLimits_t)))
+      continue;
+    char key[16];
+    snprintf(key, sizeof(key), SERVO_KEY, servoTable[id].name);
+    preferences->putBytes(key, &limits, sizeof(ServoLimits_t));
   }
 
+  return;
+}
 
-  if (servoLimits[LEYE_SERVO].limits_changed)
-  {
-    preferences->putBytes(LEYE_KEY, &servoLimits[LEYE_SERVO], sizeof(ServoLimits_t));
-    servoLimits[LEYE_SERVO].limits_changed=false;
-  }
 
+/**
+ * @brief [INTERNAL] If a setting has changed, copy it and clear its
+ *   'changed' flag - under the lock (for commit()).
+ *
+ * @param changed - its flag
+ * @param pref    - the setting
+ * @param copy    - where to copy it
+ * @param len     - its size
+ * @return true   - it had changed (and was copied)
+ */
+bool Prefs::takeChange(bool *changed, const void *pref, void *copy, size_t len)
+{
+  lock();
+  bool was = *changed;
+  if (was)
+    memcpy(copy, pref, len);
+  *changed = false;
+  unlock();
+  return (was);
+}
 
-  if (servoLimits[REYE_SERVO].limits_changed)
-  {
-    preferences->putBytes(REYE_KEY, &servoLimits[REYE_SERVO], sizeof(ServoLimits_t));
-    servoLimits[REYE_SERVO].limits_changed=false;
-  }
+bool Prefs::takeChange(bool *changed, const String *pref, String *copy)
+{
+  lock();
+  bool was = *changed;
+  if (was)
+    *copy = *pref;
+  *changed = false;
+  unlock();
+  return (was);
+}
 
-  return;
+
+/**
+ * @brief [INTERNAL] Take (give back) the settings lock. 
+ *   (Not taken before setup() - there is only one task then)
+ */
+void Prefs::lock()
+{
+  if (prefLock != nullptr)
+    xSemaphoreTake(prefLock, portMAX_DELAY);
+}
+
+void Prefs::unlock()
+{
+  if (prefLock != nullptr)
+    xSemaphoreGive(prefLock);
 }
 
 
@@ -511,42 +598,98 @@ void Prefs::commit()
 // @brief SET and GET functions for various paramters
 //- - - - - - - - -
 void Prefs::wifiSSID(String str) {
+  lock();
   pref_ssid=str;
   ssid_changed=true;
+  unlock();
 }
 
 String Prefs::wifiSSID() {
-    return (pref_ssid);
+  lock();
+  String str = pref_ssid;
+  unlock();
+  return (str);
 }
 
 
 void Prefs::wifiPass(String str) {
+  lock();
   pref_pass=str;
   pass_changed=true;
+  unlock();
 }
 
 String Prefs::wifiPass() {
-  return (pref_pass);
+  lock();
+  String str = pref_pass;
+  unlock();
+  return (str);
 }
 
 void Prefs::curtainName(String str) {
+  lock();
   pref_name = str;
   name_changed = true;
+  unlock();
 }
 
 String Prefs::curtainName() {
-  return (pref_name);
+  lock();
+  String str = pref_name;
+  unlock();
+  return (str);
 }
 
 void Prefs::udpPort(uint32_t val) {
+  lock();
   pref_portno=val;
   portno_changed = true;
+  unlock();
 }
 
 uint16_t Prefs::udpPort() {
   return(pref_portno);
 }
 
+void Prefs::serialBaud(uint32_t val) {
+  lock();
+  pref_baud = val;
+  baud_changed = true;
+  unlock();
+}
+
+uint32_t Prefs::serialBaud() {
+  return(pref_baud);
+}
+
+void Prefs::currentBudget(uint32_t val) {
+  lock();
+  pref_budget = val;
+  budget_changed = true;
+  unlock();
+}
+
+uint32_t Prefs::currentBudget() {
+  return(pref_budget);
+}
+
+void Prefs::headGeometry(int nodBase, int tiltBase, int armLen) {
+  lock();
+  pref_geometry.nodBase = nodBase;
+  pref_geometry.tiltBase = tiltBase;
+  pref_geometry.armLen = armLen;
+  geometry_changed = true;
+  unlock();
+}
+
+void Prefs::headGeometry(int *nodBase, int *tiltBase, int *armLen) {
+  lock();
+  *nodBase = pref_geometry.nodBase;
+  *tiltBase = pref_geometry.tiltBase;
+  *armLen = pref_geometry.armLen;
+  unlock();
+}
+
 
 /**
  * @brief Set a servo's min/max PWM on times
@@ -557,10 +700,13 @@ uint16_t Prefs::udpPort() {
  */
 bool  Prefs::setServoPWM(int id, int min, int max)
 {
-  if ( (id<0) || (id > NO_OF_SERVOS) ) return(false); //out of range.
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
   servoLimits[id].minimum = min;
   servoLimits[id].maximum = max;
   servoLimits[id].limits_changed=true;
+  limitsVersion++;
+  unlock();
   return(true);
 }
 
@@ -575,9 +721,11 @@ bool  Prefs::setServoPWM(int id, int min, int max)
  */
 bool Prefs::getServoPWM(int id, int *minVal, int *maxVal)
 {
-  if ( (id<0) || (id > NO_OF_SERVOS) ) return(false); //out of range.
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
   *minVal=servoLimits[id].minimum;
   *maxVal=servoLimits[id].maximum;
+  unlock();
   return(true);
 }
 
@@ -590,18 +738,315 @@ bool Prefs::getServoPWM(int id, int *minVal, int *maxVal)
  */
 bool  Prefs::setServoAngles(int id, int min, int max)
 {
-  if ( (id<0) || (id > NO_OF_SERVOS) ) return(false); //out of range.
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
   servoLimits[id].minAngle = min;
   servoLimits[id].maxAngle = max;
   servoLimits[id].limits_changed=true;
+  limitsVersion++;
+  unlock();
   return(true);
 }
 
 
   bool Prefs::getServoAngles(int id,  int *minAngle, int *maxAngle)
   {
-    if ( (id<0) || (id > NO_OF_SERVOS) ) return(false); //out of range.
+    if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+    lock();
     *minAngle = servoLimits[id].minAngle;
     *maxAngle = servoLimits[id].maxAngle;
+    unlock();
     return(true);
   }
+
+
+/**
+ * @brief Set a servo's deadband - pwm changes this small are not sent
+ * 
+ * @param id       - index of the servo
+ * @param deadband - in pwm counts (0 means only identical values are dropped)
+ */
+bool Prefs::setServoDeadband(int id, int deadband)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
+  servoLimits[id].deadband = deadband;
+  servoLimits[id].limits_changed=true;
+  unlock();
+  return(true);
+}
+
+
+int Prefs::getServoDeadband(int id)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(0); //out of range.
+  return (servoLimits[id].deadband);
+}
+
+
+/**
+ * @brief Set a servo's motion limits (see Servos.h - PROFILES)
+ * 
+ * @param id       - index of the servo
+ * @param maxVel   - degrees/sec (0: no profile - move at once)
+ * @param maxAccel - degrees/sec/sec (0: no limit)
+ * @param maxJerk  - degrees/sec/sec/sec (0: trapezoid profile)
+ */
+bool Prefs::setServoMotion(int id, int maxVel, int maxAccel, int maxJerk)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
+  servoLimits[id].maxVel = maxVel;
+  servoLimits[id].maxAccel = maxAccel;
+  servoLimits[id].maxJerk = maxJerk;
+  servoLimits[id].limits_changed = true;
+  limitsVersion++;
+  unlock();
+  return(true);
+}
+
+
+bool Prefs::getServoMotion(int id, int *maxVel, int *maxAccel, int *maxJerk)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
+  *maxVel = servoLimits[id].maxVel;
+  *maxAccel = servoLimits[id].maxAccel;
+  *maxJerk = servoLimits[id].maxJerk;
+  unlock();
+  return(true);
+}
+
+
+/**
+ * @brief Set how long a servo may sit still before its channel is
+ *   turned off (see Servos.h - IDLE)
+ * 
+ * @param id       - index of the servo
+ * @param idleSecs - seconds (0: never)
+ */
+bool Prefs::setServoIdle(int id, int idleSecs)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
+  servoLimits[id].idleSecs = idleSecs;
+  servoLimits[id].limits_changed = true;
+  unlock();
+  return(true);
+}
+
+
+int Prefs::getServoIdle(int id)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(0); //out of range.
+  return (servoLimits[id].idleSecs);
+}
+
+
+/**
+ * @brief Add (or replace) a calibration point for a servo. Points are
+ *   kept sorted by angle; a point at an angle already in the list
+ *   replaces it.
+ * 
+ * @param id    - index of the servo
+ * @param angle - angle (degrees)
+ * @param pwm   - pwm on time at that angle (0..4095)
+ * @return true  - normal
+ * @return false - invalid id, or the list is full
+ */
+bool Prefs::setServoCalPoint(int id, int angle, int pwm)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
+  ServoLimits_t *lim = &servoLimits[id];
+
+  int idx;
+  for (idx = 0; (idx < lim->calCount) && (lim->cal[idx].angle < angle); idx++)
+    ;
+  if ((idx >= lim->calCount) || (lim->cal[idx].angle != angle))
+  { // new point - make room for it
+    if (lim->calCount >= CAL_MAX_POINTS)
+    {
+      unlock();
+      return(false);
+    }
+    memmove(&lim->cal[idx + 1], &lim->cal[idx], (lim->calCount - idx) * sizeof(calPoint_t));
+    lim->calCount++;
+  }
+  lim->cal[idx].angle = angle;
+  lim->cal[idx].pwm = pwm;
+  lim->limits_changed = true;
+  limitsVersion++;
+  unlock();
+  return(true);
+}
+
+
+/**
+ * @brief Remove all of a servo's calibration points (back to a 
+ *    straight line from min to max)
+ */
+bool Prefs::clearServoCal(int id)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  lock();
+  servoLimits[id].calCount = 0;
+  servoLimits[id].limits_changed = true;
+  limitsVersion++;
+  unlock();
+  return(true);
+}
+
+
+/**
+ * @brief Get a servo's calibration points
+ * 
+ * @param id     - index of the servo
+ * @param points - where to put them (room for CAL_MAX_POINTS)
+ * @return int   - how many there are
+ */
+int Prefs::getServoCal(int id, calPoint_t *points)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(0); //out of range.
+  lock();
+  int cnt = servoLimits[id].calCount;
+  if ((cnt < 0) || (cnt > CAL_MAX_POINTS)) cnt = 0;
+  memcpy(points, servoLimits[id].cal, cnt * sizeof(calPoint_t));
+  unlock();
+  return (cnt);
+}
+
+
+/**
+ * @brief Changes every time a servo's pwm limits, angle limits, 
+ *   calibration or motion limits change - anything built from them 
+ *   must be rebuilt.
+ */
+uint32_t Prefs::getLimitsVersion()
+{
+  return (limitsVersion);
+}
+
+
+/**
+ * @brief Save a macro to flash - NOW. 
+ *   (Macros are big, so they are not kept here waiting for a commit)
+ * 
+ * @param slot - the macro slot number
+ * @param data - the saved form of the macro
+ * @param len  - its length
+ * @return true  - saved
+ * @return false - flash write failed
+ */
+bool Prefs::putMacro(int slot, const void *data, size_t len)
+{
+  char key[16];
+  snprintf(key, sizeof(key), MACRO_KEY, slot);
+  return (preferences->putBytes(key, data, len) == len);
+}
+
+
+/**
+ * @brief Read a macro back from flash
+ * 
+ * @param slot   - the macro slot number
+ * @param data   - where to put it
+ * @param maxLen - size of 'data'
+ * @return size_t  - length read. 0 if there is no (or too big a) macro in this slot
+ */
+size_t Prefs::getMacro(int slot, void *data, size_t maxLen)
+{
+  char key[16];
+  snprintf(key, sizeof(key), MACRO_KEY, slot);
+  if (!preferences->isKey(key))
+    return (0);
+  size_t len = preferences->getBytesLength(key);
+  if ((len == 0) || (len > maxLen))
+    return (0);
+  return (preferences->getBytes(key, data, len));
+}
+
+
+/**
+ * @brief Remove a macro from flash (if it is there)
+ * 
+ * @param slot - the macro slot number
+ */
+void Prefs::removeMacro(int slot)
+{
+  char key[16];
+  snprintf(key, sizeof(key), MACRO_KEY, slot);
+  if (preferences->isKey(key))
+    preferences->remove(key);
+}
+
+
+/**
+ * @brief Set a board's pwm refresh rate
+ *   NOTE: The new rate is used after the next reboot
+ *   (DONT forget to COMMIT your change!)
+ *
+ * @param board - index in servoBoards[]
+ * @param hz    - refresh rate
+ * @return true  - normal
+ * @return false - invalid board
+ */
+bool Prefs::setBoardRefresh(int board, int hz)
+{
+  if ((board < 0) || (board >= NO_OF_BOARDS)) return (false);  //out of range.
+  lock();
+  boardRefresh[board] = hz;
+  refresh_changed = true;
+  unlock();
+  return (true);
+}
+
+
+/**
+ * @brief Get a board's pwm refresh rate (Hz - 0 if invalid board)
+ */
+int Prefs::getBoardRefresh(int board)
+{
+  if ((board < 0) || (board >= NO_OF_BOARDS)) return (0);  //out of range.
+  return (boardRefresh[board]);
+}
+
+
+/**
+ * @brief Save a servo's wear counters to flash - NOW.
+ *   (Servos saves them every WEAR_SAVE_SECS - only if they changed)
+ * 
+ * @param id   - the servo
+ * @param data - the counters
+ * @param len  - their length
+ * @return true  - saved
+ * @return false - bad id, or flash write failed
+ */
+bool Prefs::putWear(int id, const void *data, size_t len)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(false); //out of range.
+  char key[16];
+  snprintf(key, sizeof(key), WEAR_KEY, servoTable[id].name);
+  return (preferences->putBytes(key, data, len) == len);
+}
+
+
+/**
+ * @brief Read a servo's wear counters back from flash
+ * 
+ * @param id     - the servo
+ * @param data   - where to put them
+ * @param maxLen - size of 'data'
+ * @return size_t  - length read. 0 if there are none (or the wrong size)
+ */
+size_t Prefs::getWear(int id, void *data, size_t maxLen)
+{
+  if ( (id<0) || (id >= NO_OF_SERVOS) ) return(0); //out of range.
+  char key[16];
+  snprintf(key, sizeof(key), WEAR_KEY, servoTable[id].name);
+  if (!preferences->isKey(key))
+    return (0);
+  if (preferences->getBytesLength(key) != maxLen)
+    return (0);
+  return (preferences->getBytes(key, data, maxLen));
+}
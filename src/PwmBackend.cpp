@@ -0,0 +1,78 @@
+/**
+ * @file PwmBackend.cpp
+ * @author Doug Fajardo
+ * @brief  A board of PWM channels - where the servo frame task's output goes
+ * @version 0.1
+ * @date 2024-09-26
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Config.h"
+#include "PwmBackend.h"
+#include "Pca9685Backend.h"
+#include "LedcBackend.h"
+
+/* STATIC DECLARATIONS */
+pwmDone_t PwmBackend::doneFn = nullptr;
+
+
+PwmBackend::PwmBackend()
+{
+  memset(phase, 0, sizeof(phase));
+}
+
+
+/**
+ * @brief Set when a channel's pulse starts (a backend applies it from
+ *   its begin() on)
+ *
+ * @param chan   - the channel
+ * @param counts - offset from the start of the period (0..4095)
+ */
+void PwmBackend::setPhase(int chan, uint16_t counts)
+{
+  if ((chan >= 0) && (chan < CHANNELS_PER_BOARD))
+    phase[chan] = counts & 4095;
+}
+
+
+/**
+ * @brief Make the backend for one board (as servoBoards[] says)
+ *
+ * @param board - index in servoBoards[]
+ * @return PwmBackend* - the new backend
+ */
+PwmBackend *PwmBackend::create(int board)
+{
+  switch (servoBoards[board].type)
+  {
+  case PWM_LEDC:
+    return (new LedcBackend(board));
+
+  case PWM_PCA9685:
+  default:
+    return (new Pca9685Backend(board, servoBoards[board].addr));
+  }
+}
+
+
+/**
+ * @brief Set the function every backend calls when a burst is finished
+ *
+ * @param fn - the function (called on whatever task finished the burst)
+ */
+void PwmBackend::setDone(pwmDone_t fn)
+{
+  doneFn = fn;
+}
+
+
+/**
+ * @brief [INTERNAL] A burst is finished - tell the owner
+ */
+void PwmBackend::finished(const pwmBurst_t *burst, bool ok)
+{
+  if (doneFn != nullptr)
+    doneFn(burst, ok);
+}
@@ -0,0 +1,158 @@
+/**
+ * @file ResponseBuf.cpp
+ * @author Doug Fajardo
+ * @brief  Collect a command's response, and send it in one write.
+ * @version 0.1
+ * @date 2024-09-10
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#include "Config.h"
+#include "ResponseBuf.h"
+
+
+ResponseBuf::ResponseBuf()
+{
+  target = nullptr;
+  used = 0;
+}
+
+ResponseBuf::~ResponseBuf()
+{
+}
+
+
+/**
+ * @brief Run time setup
+ * 
+ * @param targetStream - where the response is sent by flush()
+ */
+void ResponseBuf::begin(Stream *targetStream)
+{
+  target = targetStream;
+  used = 0;
+}
+
+
+/**
+ * @brief Add one character to the response
+ * 
+ * @param ch 
+ * @return size_t - 1 (always)
+ */
+size_t ResponseBuf::write(uint8_t ch)
+{
+  if (used >= RESP_BUF_LEN)
+    flush();
+  buf[used++] = ch;
+  return (1);
+}
+
+
+/**
+ * @brief Add a block of characters to the response
+ *   (if it doesn't fit, whatever is buffered is sent first)
+ * 
+ * @param data 
+ * @param len 
+ * @return size_t - len (always)
+ */
+size_t ResponseBuf::write(const uint8_t *data, size_t len)
+{
+  size_t left = len;
+  while (left > 0)
+  {
+    if (used >= RESP_BUF_LEN)
+      flush();
+    size_t chunk = RESP_BUF_LEN - used;
+    if (chunk > left) chunk = left;
+    memcpy(&buf[used], data, chunk);
+    used += chunk;
+    data += chunk;
+    left -= chunk;
+  }
+  return (len);
+}
+
+
+/**
+ * @brief printf straight into the buffer (no heap, no temp buffer)
+ *   If it doesn't fit, the buffer is flushed and we try again. Output
+ *   longer than RESP_BUF_LEN is truncated.
+ * 
+ * @param format - printf format
+ * @param ...  
+ * @return size_t - number of characters added
+ */
+size_t ResponseBuf::appendf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf((char *)&buf[used], RESP_BUF_LEN - used, format, args);
+  va_end(args);
+  if (len < 0)
+    return (0);
+
+  if ((size_t)len >= RESP_BUF_LEN - used)
+  { // Didn't fit (the part that did is not counted)
+    if (used > 0)
+    {
+      flush();
+      va_start(args, format);
+      len = vsnprintf((char *)&buf[used], RESP_BUF_LEN - used, format, args);
+      va_end(args);
+      if (len < 0)
+        return (0);
+    }
+    if ((size_t)len >= RESP_BUF_LEN - used)
+      len = RESP_BUF_LEN - used - 1;  // truncated
+  }
+  used += len;
+  return (len);
+}
+
+
+/**
+ * @brief printf to any stream, without the heap: format on the stack,
+ *   then one write(). Output longer than RESP_LINE_LEN-1 is truncated.
+ *   (Use this, not Stream::printf(), in command functions)
+ * 
+ * @param out    - where to send it
+ * @param format - printf format
+ * @param ...  
+ * @return size_t - number of characters written
+ */
+size_t ResponseBuf::printTo(Stream *out, const char *format, ...)
+{
+  char line[RESP_LINE_LEN];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len < 0)
+    return (0);
+  if ((size_t)len >= sizeof(line))
+    len = sizeof(line) - 1;  // truncated
+  return (out->write((const uint8_t *)line, len));
+}
+
+
+/**
+ * @brief Send the buffered response to the target stream, in one write.
+ */
+void ResponseBuf::flush()
+{
+  if ((used > 0) && (target != nullptr))
+    target->write(buf, used);
+  used = 0;
+}
+
+
+/**
+ * @brief Throw away anything buffered
+ */
+void ResponseBuf::discard()
+{
+  used = 0;
+}
@@ -8,6 +8,17 @@
 #include "SerialCmd.h"
 #include "Commands.h"
 
+bool SerialCmd::echoOn = true;
+
+// Serial port commands (added to the command index by begin())
+const cmdList_t SerialCmd::cmdList[] =
+{
+  {COMMENT, " ",                                          1, 1,  nullptr},
+  {COMMENT, " - - - SERIAL PORT - - - - -",               1, 1,  nullptr},
+  {"echo",  "echo [on|off] - echo input (off for programs)", 1, 2, SerialCmd::echoCmd},
+  {"END",   "END",                                        0, 0,  nullptr}  // end-of-list
+};
+
 SerialCmd::SerialCmd()
 {
 
@@ -19,11 +30,25 @@ SerialCmd::~SerialCmd()
 
 /**
  * @brief initialize the serial port
- * 
+ *   (Serial.begin() is done in setup(). We switch to the 
+ *    baud rate from Prefs here)
  */
 void SerialCmd::begin()
 {  
   Commands::begin( &Serial);
+  Commands::addCmdList(cmdList);
+
+  if (Prefs::serialBaud() != BAUD_DEF)
+  {
+    Serial.printf("Serial: switching to %u baud\r\n", Prefs::serialBaud());
+    Serial.flush();
+    Serial.updateBaudRate(Prefs::serialBaud());
+  }
+
+#ifdef SERIAL_EVENT_DRIVEN
+  Serial.setRxFIFOFull(SERIAL_RX_CHUNK);
+  Serial.onReceive([this]() { rxChunk(); }, false);
+#endif
 }
 
 /**
@@ -33,12 +58,75 @@ void SerialCmd::begin()
  */
 void SerialCmd::loop()
 {
-   while (Serial.available()) {  // there is a character ready
-    int ch = Serial.read();    
-    if (ch == -1) return; // shouldn't happen, but...
-    if (ch == '\r') Serial.println(" ");
-    Serial.print((char)ch);
-    recvdChar(ch);
-  }
+#ifndef SERIAL_EVENT_DRIVEN
+  rxChunk();
+#endif
 } // end of loop
 
+
+/**
+ * @brief [INTERNAL] Read whatever is waiting, a chunk at a time, 
+ *   echo it (in one write) and pass it to Commands::recvStr().
+ *   Binary frames are never echoed.
+ */
+void SerialCmd::rxChunk()
+{
+  uint8_t chunk[SERIAL_RX_CHUNK];
+  uint8_t echo[SERIAL_RX_CHUNK * 4];
+
+  while (Serial.available())
+  {
+    size_t len = Serial.read(chunk, sizeof(chunk));
+    if (len == 0) return; // shouldn't happen, but...
+
+    if (echoOn && !inBinaryFrame() && (memchr(chunk, BIN_FRAME_DELIM, len) == nullptr))
+    {
+      size_t echoLen = 0;
+      for (size_t idx = 0; idx < len; idx++)
+      {
+        if (chunk[idx] == '\r')
+        { // same as println(" ")
+          echo[echoLen++] = ' ';
+          echo[echoLen++] = '\r';
+          echo[echoLen++] = '\n';
+        }
+        echo[echoLen++] = chunk[idx];
+      }
+      Serial.write(echo, echoLen);
+    }
+    recvStr((char *)chunk, len);
+  }
+}
+
+
+/**
+ * @brief command to get (or set) input echo
+ *    echo          (1 token) show the setting
+ *    echo on|off   (2 tokens) change it
+ * 
+ * @param outStream - where to send the result
+ * @param tokCnt    - how many tokens? 1 means get it, 2 means set it
+ * @param tokens    - list of tokens
+ */
+void SerialCmd::echoCmd(Stream *outStream, int tokCnt, char **tokens)
+{
+  if (tokCnt == 2)
+  {
+    if (0 == strcasecmp(tokens[1], "on"))
+      echoOn = true;
+    else if (0 == strcasecmp(tokens[1], "off"))
+      echoOn = false;
+    else
+    {
+#ifdef VERBOSE_RESPONSES
+      outStream->println("echo: expected 'on' or 'off'");
+#endif
+      outStream->println(ERR_RESPONSE);
+      return;
+    }
+  }
+#ifdef VERBOSE_RESPONSES
+  ResponseBuf::printTo(outStream, "ECHO: %s\r\n", echoOn ? "on" : "off");
+#endif
+  outStream->println(OK_RESPONSE);
+}
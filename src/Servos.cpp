@@ -20,10 +20,150 @@
 #include "Servos.h"
 #include "Prefs.h"
 #include "Commands.h"
+#include "Stats.h"
+#include "I2cBus.h"
+#include "esp_timer.h"
+#include "FixMath.h"
 
 /* STATIC DECLARATIONS */
-Adafruit_PWMServoDriver Servos::hw716;
+PwmBackend *Servos::boards[NO_OF_BOARDS];
+int8_t Servos::chanMap[NO_OF_BOARDS][CHANNELS_PER_BOARD];
+int8_t Servos::nameIndex[SERVO_HASH_SIZE];
+int8_t Servos::prioOrder[NO_OF_SERVOS];
+
+static_assert((SERVO_HASH_SIZE & (SERVO_HASH_SIZE - 1)) == 0, "SERVO_HASH_SIZE must be a power of 2");
+static_assert(SERVO_HASH_SIZE >= 2 * NO_OF_SERVOS, "SERVO_HASH_SIZE is too small");
+static_assert(NO_OF_SERVOS <= 127, "servo ids must fit an int8_t");
+static_assert(POSE_SERVOS <= NO_OF_SERVOS, "not enough servos for a pose");
+static_assert(CHANNELS_PER_BOARD <= 256, "a burst's channels must fit a uint8_t");
+static_assert(servoTable[JAW_SERVO].hash == cmdHash("JAW") && servoTable[ROT_SERVO].hash == cmdHash("ROT") &&
+              servoTable[LEFT_SERVO].hash == cmdHash("LEFT") && servoTable[RIGHT_SERVO].hash == cmdHash("RIGHT") &&
+              servoTable[LEYE_SERVO].hash == cmdHash("LEYE") && servoTable[REYE_SERVO].hash == cmdHash("REYE"),
+              "head servo ids don't match servoTable[]");
 Servos::servoList_t Servos::servoList[NO_OF_SERVOS];
+SemaphoreHandle_t Servos::hwLock = nullptr;
+int Servos::batchDepth = 0;
+TaskHandle_t Servos::frameTask = nullptr;
+esp_timer_handle_t Servos::frameTimer = nullptr;
+uint32_t Servos::framePeriodUs = 1000000 / SERVO_PWM_FREQ;
+uint16_t Servos::boardHz[NO_OF_BOARDS];
+uint8_t Servos::frameDiv[NO_OF_BOARDS];
+bool Servos::inputPending = false;
+uint32_t Servos::pendingStamp = 0;
+thread_local uint32_t Servos::inputStamp = 0;
+Servos::frameStats_t Servos::frameStats;
+Histogram Servos::burstTime;
+Servos::servoLut_t Servos::lut[NO_OF_SERVOS];
+uint32_t Servos::lutVersion = 0;
+uint32_t Servos::lastWearSave = 0;
+
+// Argument schemas
+static const argSpec_t pwmLimitArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT16, 0, 4095,             "min pwm"},
+  {ARG_INT16, 0, 4095,             "max pwm"}
+};
+
+static const argSpec_t angleLimitArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT16, -180, 180,           "min angle"},
+  {ARG_INT16, -180, 180,           "max angle"}
+};
+
+static const argSpec_t calPointArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT16, SERVO_LUT_MIN_ANGLE, SERVO_LUT_MAX_ANGLE, "angle"},
+  {ARG_INT16, 0, 4095,             "pwm"}
+};
+
+static const argSpec_t calClearArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"}
+};
+
+static const argSpec_t angleArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_CDEG,  SERVO_LUT_MIN_ANGLE * CDEG_PER_DEG, SERVO_LUT_MAX_ANGLE * CDEG_PER_DEG, "angle"}
+};
+
+static const argSpec_t motionArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT32, 0, 3600,             "max velocity"},
+  {ARG_INT32, 0, 100000,           "max acceleration"},
+  {ARG_INT32, 0, 1000000,          "max jerk"}
+};
+
+static const argSpec_t deadbandArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT16, 0, 200,              "deadband"}
+};
+
+static const argSpec_t wearArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_STR,   0, 0,                "reset"}
+};
+
+static const argSpec_t budgetArgs[] =
+{
+  {ARG_INT32, 0, 100000,           "milliamps"}
+};
+
+static const argSpec_t idleArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT32, 0, 86400,            "idle seconds"}
+};
+
+static const argSpec_t refreshArgs[] =
+{
+  {ARG_INT16, 0, NO_OF_BOARDS - 1,  "board"},
+  {ARG_INT16, SERVO_MIN_FREQ, SERVO_MAX_FREQ, "refresh rate"}
+};
+
+static const argSpec_t servoPosArgs[] =
+{
+  {ARG_SERVO, 0, NO_OF_SERVOS - 1, "servo"},
+  {ARG_INT16, 0, 4096,             "new position"}
+};
+
+static const argSpec_t setpointArgs[POSE_SERVOS] =
+{
+  {ARG_CDEG, -180 * CDEG_PER_DEG, 180 * CDEG_PER_DEG, "angle"}, {ARG_CDEG, -180 * CDEG_PER_DEG, 180 * CDEG_PER_DEG, "angle"},
+  {ARG_CDEG, -180 * CDEG_PER_DEG, 180 * CDEG_PER_DEG, "angle"}, {ARG_CDEG, -180 * CDEG_PER_DEG, 180 * CDEG_PER_DEG, "angle"},
+  {ARG_CDEG, -180 * CDEG_PER_DEG, 180 * CDEG_PER_DEG, "angle"}, {ARG_CDEG, -180 * CDEG_PER_DEG, 180 * CDEG_PER_DEG, "angle"}
+};
+
+// Servo limit commands (added to the command index by begin())
+const cmdList_t Servos::cmdList[] =
+{
+  {COMMENT,   " ",                                 1, 1,           nullptr},
+  {COMMENT,  " - - - SERVO LIMIT SETTINGS - - -",  1, 1,           nullptr},
+  {COMMENT,  " Valid <servo> names are:  rot, jaw, leye, reye, left, right", 1, 1, nullptr},
+  {"setpwm","setpwm <servo> <min_pwm_on_time> <max_pwm_on_time> (0...4095)", 4,4, pwmLimitArgs, Servos::ServoSetPwmlimitsExec},
+  {"setAngle","setAngle <servo> <minAngle> <maxAngle>  (in degrees",         4,4, angleLimitArgs, Servos::ServoAnglelimitsExec},
+  {"calpoint","calpoint <servo> <angle> <pwm>  add a calibration point (between min and max)", 4,4, calPointArgs, Servos::calPointExec},
+  {"calclear","calclear <servo>  remove all calibration points",  2,2, calClearArgs, Servos::calClearExec},
+  {"motion",  "motion <servo> [<deg/s> [<deg/s/s> [<deg/s/s/s>]]]  get/set motion limits (0 deg/s: no profile)", 2,5, motionArgs, Servos::motionExec},
+  {"deadband","deadband <servo> [<counts>]  get/set the pwm deadband (changes this small are not sent)", 2,3, deadbandArgs, Servos::deadbandExec},
+  {"wear",    "wear [<servo> [reset]]  show (or reset - after a servo is replaced) the wear counters", 1,3, wearArgs, Servos::wearExec, 0, CMD_SLOW},
+  {"budget",  "budget [<mA>]  get/set the servo current budget (0: no limit)", 1,2, budgetArgs, Servos::budgetExec},
+  {"idle",    "idle <servo> [<secs>]  get/set the idle time (channel off after this long still - 0: never)", 2,3, idleArgs, Servos::idleExec},
+  {"refresh", "refresh <board> [<hz>]  get/set a board's pwm refresh rate (after reboot)", 2,3, refreshArgs, Servos::refreshExec},
+  {"servo",   "servo <servo> <minAngle> <maxAngle>    set actual pwm (in degrees0)", 3,3, servoPosArgs, Servos::ServoPosExec, OP_SERVO},
+  {"angle",   "angle <servo> <degrees>  move a servo (degrees may have 2 decimals: 12.25)", 3,3, angleArgs, Servos::angleExec, OP_ANGLE},
+  {"begin",   "begin    - start a batch (servo changes are held until 'end')", 1, 1, nullptr, Servos::beginExec, OP_BEGIN},
+  {"end",     "end      - send all servo changes since 'begin' at once",       1, 1, nullptr, Servos::endExec, OP_END},
+  {"setpoint","setpoint <right> <left> <rot> <jaw> <leye> <reye>  set all servo angles (degrees may have 2 decimals)", POSE_SERVOS+1, POSE_SERVOS+1,
+                                                                    setpointArgs, Servos::setpointExec, OP_SETPOINT},
+  {"END",     "END",                               0, 0,           nullptr}  // end-of-list
+};
 
 /**
  * @brief Construct a new Kinemetics object
@@ -36,20 +176,129 @@ Servos::servoList_t Servos::servoList[NO_OF_SERVOS];
  */
 Servos::Servos()
 {
-    hw716 = Adafruit_PWMServoDriver(); // init with I2c address 0x40
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+        boards[board] = PwmBackend::create(board);
+        boardHz[board] = servoBoards[board].freqHz;
+        frameDiv[board] = 1;
+        for (int chan = 0; chan < CHANNELS_PER_BOARD; chan++)
+            chanMap[board][chan] = -1;
+    }
+    memset(nameIndex, -1, sizeof(nameIndex));
+
     for (int id=0; id<NO_OF_SERVOS; id++)
     {
+        const servoDesc_t *desc = &servoTable[id];
+        if ((desc->board < NO_OF_BOARDS) && (desc->channel < CHANNELS_PER_BOARD))
+            chanMap[desc->board][desc->channel] = id;
+        int slot = desc->hash & (SERVO_HASH_SIZE - 1);
+        while (nameIndex[slot] >= 0)
+            slot = (slot + 1) & (SERVO_HASH_SIZE - 1);
+        nameIndex[slot] = id;
+
         servoList[id].lastPos=0;
         servoList[id].ServoIsDefined=false;
+        servoList[id].staged=false;
+        servoList[id].stagedPwm=0;
+        servoList[id].stagedPos=0;
+        servoList[id].stagedMove=false;
+        servoList[id].stagedAtLimit=false;
+        servoList[id].pwm=0;
+        servoList[id].dirty=false;
+        servoList[id].hwPwm=-1;
+        memset(&servoList[id].prof, 0, sizeof(profile_t));
+        servoList[id].armed=false;
+        servoList[id].lastActive=0;
+        servoList[id].armedSince=0;
+        servoList[id].energisedMs=0;
+        servoList[id].idleOffs=0;
+        servoList[id].jumpTicks=0;
+        servoList[id].travelCdeg=0;
+        servoList[id].reversals=0;
+        servoList[id].lastDir=0;
+        servoList[id].atLimit=false;
+        servoList[id].limitSince=0;
+        servoList[id].limitMs=0;
+        servoList[id].wearChanged=false;
+
+        // current budget order: lowest priority first (stable)
+        int pos = id;
+        while ((pos > 0) && (servoTable[prioOrder[pos - 1]].priority > desc->priority))
+        {
+            prioOrder[pos] = prioOrder[pos - 1];
+            pos--;
+        }
+        prioOrder[pos] = id;
     }
 }
 
 
 void Servos::begin()
 {
-    hw716.begin(); // start the servo driver
-    // hw715.setOscillatorFrequency(27000000); IF we need to trim HW716 osc freq
-    hw716.setPWMFreq(SERVO_PWM_FREQ);
+    if (hwLock == nullptr)
+        hwLock = xSemaphoreCreateMutex();
+    loadWear();
+    lastWearSave = millis();
+    PwmBackend::setDone(burstDone);
+    staggerPhases();
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+        // (a rate saved before the limits grew may no longer fit)
+        boardHz[board] = min(Prefs::getBoardRefresh(board), maxRefresh(board));
+        boards[board]->begin(boardHz[board]);   // start the servo driver
+    }
+    Commands::addCmdList(cmdList);
+
+    // Frame timer - at the fastest board's own PWM period. The others
+    //   are sent every frameDiv'th frame.
+    uint32_t period = 0;
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+        uint32_t boardPeriod = boards[board]->periodUs();
+        if ((boardPeriod > 0) && ((period == 0) || (boardPeriod < period)))
+            period = boardPeriod;
+    }
+    if (period > 0) framePeriodUs = period;
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+        frameDiv[board] = constrain((int)((boards[board]->periodUs() + framePeriodUs / 2) / framePeriodUs), 1, 255);
+    lock();
+    refreshTables(true);   // (tables and profiles depend on the rates)
+    unlock();
+    if (frameTask == nullptr)
+    {
+        xTaskCreatePinnedToCore(frameLoop, "servoFrame", SERVO_FRAME_STACK, nullptr, SERVO_FRAME_PRIO, &frameTask, SERVO_FRAME_CORE);
+        esp_timer_create_args_t timerArgs = {};
+        timerArgs.callback = frameTick;
+        timerArgs.dispatch_method = ESP_TIMER_TASK;
+        timerArgs.name = "servoFrame";
+        timerArgs.skip_unhandled_events = true;
+        esp_timer_create(&timerArgs, &frameTimer);
+        esp_timer_start_periodic(frameTimer, framePeriodUs);
+    }
+}
+
+
+/**
+ * @brief [INTERNAL] Set each channel's pulse start: the servos on a 
+ *   board are spread evenly over the pwm period (in channel order).
+ *   With PWM_STAGGER undefined, every pulse starts at count 0.
+ */
+void Servos::staggerPhases()
+{
+#ifdef PWM_STAGGER
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+        int used = 0;
+        for (int chan = 0; chan < CHANNELS_PER_BOARD; chan++)
+            if (chanMap[board][chan] >= 0)
+                used++;
+
+        int idx = 0;
+        for (int chan = 0; chan < CHANNELS_PER_BOARD; chan++)
+            if (chanMap[board][chan] >= 0)
+                boards[board]->setPhase(chan, (idx++ * 4096) / used);
+    }
+#endif
 }
 
 
@@ -63,6 +312,24 @@ Servos::~Servos()
 }
 
 
+/**
+ * @brief [INTERNAL] Lock/unlock the servo driver.
+ *   Command sessions may run on different tasks, so every access to
+ *   servoList is done with the lock held.
+ */
+void Servos::lock()
+{
+    if (hwLock != nullptr)
+        xSemaphoreTake(hwLock, portMAX_DELAY);
+}
+
+void Servos::unlock()
+{
+    if (hwLock != nullptr)
+        xSemaphoreGive(hwLock);
+}
+
+
 /**
  * @brief [INTERNAL] Decode the string to determine what servo is named
  * 
@@ -72,20 +339,14 @@ Servos::~Servos()
  */
 int Servos::decodeId(const char *str)
 {
-    int res = -1; 
-    if (0 == strcasecmp(str,"JAW"))
-        res= JAW_SERVO;
-    else if (0 == strcasecmp(str, "ROT"))
-        res = ROT_SERVO;
-    else if (0 == strcasecmp(str, "LEFT"))
-        res = LEFT_SERVO;
-    else if (0 == strcasecmp(str, "RIGHT"))
-        res = RIGHT_SERVO;
-    else if (0 == strcasecmp(str, "LEYE"))
-        res = LEYE_SERVO;
-    else if (0 == strcasecmp(str, "REYE"))
-        res = REYE_SERVO;
-    return (res);
+    uint32_t hash = cmdHash(str);
+    for (int slot = hash & (SERVO_HASH_SIZE - 1); nameIndex[slot] >= 0; slot = (slot + 1) & (SERVO_HASH_SIZE - 1))
+    {
+        int id = nameIndex[slot];
+        if ((servoTable[id].hash == hash) && (0 == strcasecmp(str, servoTable[id].name)))
+            return (id);
+    }
+    return (-1);
 }
 
 
@@ -101,240 +362,1483 @@ int Servos::decodeId(const char *str)
  */
 bool Servos::getMinMaxAngles(int id, int *minAngle, int *maxAngle)
 {
-    switch (id)
-    {
-    case (JAW_SERVO): // Single Servos
-    case (ROT_SERVO):
-    case (LEFT_SERVO):
-    case (RIGHT_SERVO):
-    case (LEYE_SERVO):
-    case (REYE_SERVO):
-        Prefs::getServoAngles(id, minAngle, maxAngle);
-        break;
-
-    case (-1):
+    if ((id < 0) || (id >= NO_OF_SERVOS))
         return (false);
-    }
+    Prefs::getServoAngles(id, minAngle, maxAngle);
     return (true);
 }
 
 
 /**
- * @brief Set the indicated servo to a position (angle +/- 90)
- *
- * @param id <ServoId_t>- name of servo to set
- * @param pos desired position (in degrees... 0 +/- 90)
- * @return true - normal.
- * @return false - error in input (nivalidi servo id)
+ * @brief [INTERNAL] Convert a pwm on time in counts of a SERVO_PWM_FREQ
+ *   period (the unit of every pwm limit in Prefs) to fine counts of
+ *   the servo's own board period.
+ * 
+ * @param id     - the servo (must be valid)
+ *   An on time too long for the board's period (see maxRefresh()) is 
+ *   NOT made full on (that is DC - no pulse at all): it is cut to the
+ *   longest real pulse, and counted ('stats').  (Caller must hold the lock)
+ * 
+ * @param id     - the servo (must be valid)
+ * @param counts - on time (0..4095)
+ * @return int   - fine counts (0 ... PWM_MAX_PULSE)
  */
-bool Servos::setServoAngle(int id, int pos)
+int Servos::toFine(int id, int counts)
 {
-    int minAngle,maxAngle;
-    int minPwm,maxPwm=0;
-    int pwmVal;
+    if (counts <= 0)
+        return (0);
+    int fine = ((counts * boardHz[servoTable[id].board] << PWM_FINE_BITS) + SERVO_PWM_FREQ / 2) / SERVO_PWM_FREQ;
+    if (fine > PWM_MAX_PULSE)
+    {
+        frameStats.clipped++;
+        fine = PWM_MAX_PULSE;
+    }
+    return (fine);
+}
+
 
-    switch (id)
+/**
+ * @brief [INTERNAL] The longest pwm on time (counts of a SERVO_PWM_FREQ
+ *   period) any servo on a board may be sent: its pwm limits, and any
+ *   calibration points (Prefs).
+ * 
+ * @param board - index in servoBoards[]
+ * @return int  - counts (0 if no servo is on it)
+ */
+int Servos::maxPulse(int board)
+{
+    Prefs::calPoint_t cal[CAL_MAX_POINTS];
+    int longest = 0;
+    for (int id = 0; id < NO_OF_SERVOS; id++)
     {
-    case (JAW_SERVO):  // angle in degrees
-    case (ROT_SERVO):  // angle in degrees
-    case (LEFT_SERVO):   // angle in degrees
-    case (RIGHT_SERVO):  // angle in degrees
-    case (LEYE_SERVO): // percentage of brightness
-    case (REYE_SERVO): // percentage of brightness
+        if (servoTable[id].board != board)
+            continue;
+        int minPwm, maxPwm;
         Prefs::getServoPWM(id, &minPwm, &maxPwm);
-        Prefs::getServoAngles(id, &minAngle, &maxAngle);
-        if (pos < minAngle) pos=minAngle;  // limit range
-        if (pos > maxAngle) pos=maxAngle;
-        pwmVal=map(pos, minAngle,maxAngle, minPwm, maxPwm);
-        
-        hw716.setPin(id, pwmVal, false);
-        servoList[id].lastPos=pos;
-        return (true);
-
-    default:
-        return(false);
+        longest = max(longest, max(minPwm, maxPwm));
+        int calCnt = Prefs::getServoCal(id, cal);
+        for (int idx = 0; idx < calCnt; idx++)
+            longest = max(longest, (int)cal[idx].pwm);
     }
+    return (longest);
 }
 
 
 /**
- * @brief Return the current position of the microcontroller
- *
- * @param id - the ID of the servo. ONLY SINGLE SERVOS ARE ACCEPTED!
- * @return int The current angle (in degrees 0 +/- 90). 
- *        INT_MAX if servo-id is invalid.
+ * @brief The fastest refresh rate a board can run at: every servo's 
+ *   longest pulse (maxPulse()) must still fit in the period.
+ *     counts * hz / SERVO_PWM_FREQ < 4096
+ * 
+ * @param board - index in servoBoards[]
+ * @return int  - Hz (SERVO_MAX_FREQ at most)
  */
-int Servos::getServoAngle(int id)
+int Servos::maxRefresh(int board)
+{
+    int longest = maxPulse(board);
+    if (longest <= 0)
+        return (SERVO_MAX_FREQ);
+    return (min(SERVO_MAX_FREQ, (4096 * SERVO_PWM_FREQ - 1) / longest));
+}
+
+
+/**
+ * @brief [INTERNAL] Build one servo's angle->pwm table from its limits
+ *   and calibration points in Prefs.  (Caller must hold the lock)
+ * 
+ * @param id  - the servo (must be valid)
+ */
+void Servos::buildLut(int id)
 {
-    switch (id)
+    Prefs::calPoint_t pts[CAL_MAX_POINTS + 2];
+    int minAngle, maxAngle, minPwm, maxPwm;
+    Prefs::getServoPWM(id, &minPwm, &maxPwm);
+    Prefs::getServoAngles(id, &minAngle, &maxAngle);
+    if (minAngle > maxAngle)
+    {   // reversed limits - the curve still runs from low angle to high
+        int tmp = minAngle; minAngle = maxAngle; maxAngle = tmp;
+        tmp = minPwm; minPwm = maxPwm; maxPwm = tmp;
+    }
+    minAngle = constrain(minAngle, SERVO_LUT_MIN_ANGLE, SERVO_LUT_MAX_ANGLE);
+    maxAngle = constrain(maxAngle, SERVO_LUT_MIN_ANGLE, SERVO_LUT_MAX_ANGLE);
+
+    // The curve: min, any calibration points strictly inside, then max
+    Prefs::calPoint_t cal[CAL_MAX_POINTS];
+    int calCnt = Prefs::getServoCal(id, cal);
+    int cnt = 0;
+    pts[cnt].angle = minAngle;  pts[cnt++].pwm = minPwm;
+    for (int idx = 0; idx < calCnt; idx++)
+        if ((cal[idx].angle > minAngle) && (cal[idx].angle < maxAngle))
+            pts[cnt++] = cal[idx];
+    pts[cnt].angle = maxAngle;  pts[cnt++].pwm = maxPwm;
+
+    servoLut_t *tbl = &lut[id];
+    tbl->lowAngle = minAngle;
+    tbl->highAngle = maxAngle;
+    tbl->pwm[minAngle - SERVO_LUT_MIN_ANGLE] = toFine(id, minPwm);
+    int seg = 0;
+    for (int angle = minAngle + 1; angle <= maxAngle; angle++)
     {
-    case (JAW_SERVO):
-    case (ROT_SERVO):
-    case (LEFT_SERVO):
-    case (RIGHT_SERVO):
-    case (LEYE_SERVO):
-    case (REYE_SERVO):        
-        return(servoList[id].lastPos);
+        while (angle > pts[seg + 1].angle)
+            seg++;
+        const Prefs::calPoint_t *p0 = &pts[seg];
+        const Prefs::calPoint_t *p1 = &pts[seg + 1];
+        int pwm0 = toFine(id, p0->pwm);
+        int pwm1 = toFine(id, p1->pwm);
+        tbl->pwm[angle - SERVO_LUT_MIN_ANGLE] = pwm0 + (angle - p0->angle) * (pwm1 - pwm0) / (p1->angle - p0->angle);
     }
-    return (INT_MAX);
 }
 
 
 /**
- * @brief set the servo's PWM limits 
- *      <setpwm <servoID> <min> <max>  
- *       min and max range 0...4096
- * @param outStream - where to send the response
- * @param tokCnt    - how many tokens?
- * @param argList   - list of pointers to tokens
+ * @brief [INTERNAL] Convert a servo's motion limits (Prefs - per second)
+ *   to profile units (per frame tick).  (Caller must hold the lock)
+ * 
+ * @param id  - the servo (must be valid)
  */
-void Servos::ServoSetPwmlimitsCmd(Stream *outStream, int tokCnt, char *tokens[])
+void Servos::loadMotion(int id)
 {
-    int id = 0; // Decode the ID
-    id = decodeId(tokens[1]);
-    if (id < 0)
+    int limit[3];
+    int32_t perTick[3];
+    profile_t *prof = &servoList[id].prof;
+    Prefs::getServoMotion(id, &limit[0], &limit[1], &limit[2]);
+
+    // degrees per second^n -> (centidegrees << PROF_SHIFT) per tick^n
+    for (int order = 0; order < 3; order++)
     {
-        #ifdef VERBOSE_RESPONSES
-        outStream->println("Invalid servo id");
-        #endif
-        outStream->println(ERR_RESPONSE);
-        return;
+        uint64_t val = (uint64_t)((limit[order] > 0) ? limit[order] : 0) * (CDEG_PER_DEG << PROF_SHIFT);
+        for (int n = 0; n <= order; n++)
+            val = val * framePeriodUs / 1000000;
+        if ((val == 0) && (limit[order] > 0)) val = 1;
+        if (val > INT32_MAX / 4) val = INT32_MAX / 4;
+        perTick[order] = val;
     }
 
-    // put
-    int smin;
-    if (! Commands::decodeIntToken(outStream, "setlimit",  tokens[2], 0,4095, &smin))
+    prof->velMax = perTick[0];
+    prof->velCap = prof->velMax;
+    prof->accMax = (limit[1] > 0) ? perTick[1] : INT32_MAX / 4;
+    int len = 1;
+    if ((limit[1] > 0) && (perTick[2] > 0))
+    {   // the acceleration ramps up over accel/jerk ticks
+        len = perTick[1] / perTick[2];
+        len = constrain(len, 1, PROF_FILTER_MAX);
+    }
+    if (len != prof->filterLen)
     {
-        #ifdef VERBOSE_RESPONSES
-        outStream->println("Invalid value for minimum pwm. Range is 0..4095");
-        #endif
-        outStream->println(ERR_RESPONSE);
-        return;
+        prof->filterLen = len;
+        prof->trapPos = prof->pos;
+        resetFilter(prof);
     }
+    if (prof->velMax == 0)
+        prof->moving = false;
+}
 
-    int smax;
-    if (! Commands::decodeIntToken(outStream, "setlimit",  tokens[3], 0,4095, &smax))
-    {
-    
-        #ifdef VERBOSE_RESPONSES
-        outStream->println("Invalid value for minimum pwm. Range is 0..4095");
-        #endif
-        outStream->println(ERR_RESPONSE);
+
+/**
+ * @brief [INTERNAL] If any servo limits changed (Prefs), rebuild the
+ *   angle->pwm tables and motion limits.  (Caller must hold the lock)
+ * 
+ * @param force - rebuild them anyway (the board rates changed)
+ */
+void Servos::refreshTables(bool force)
+{
+    uint32_t version = Prefs::getLimitsVersion();
+    if (!force && (version == lutVersion))
         return;
+    for (int idx = 0; idx < NO_OF_SERVOS; idx++)
+    {
+        buildLut(idx);
+        loadMotion(idx);
     }
+    lutVersion = version;
+}
 
-    if (smin >=smax)
-    { 
-        #ifdef VERBOSE_RESPONSES
-        outStream->println("Invalid range - min is greater than (or equal to) max");
-        outStream->print("Values are "); outStream->print(smin); outStream->print(" "); outStream->println(smax);
-        #endif
-        outStream->println(ERR_RESPONSE);
-        return;
+
+/**
+ * @brief [INTERNAL] Convert an angle to a pwm value, using the servo's
+ *   table. The angle is clamped to the servo's range. A fraction of a
+ *   degree is interpolated between the two table entries. If the 
+ *   limits changed since the tables were built, they are rebuilt first.
+ *   (Caller must hold the lock)
+ * 
+ * @param id  - the servo (must be valid)
+ * @param pos - angle, in centidegrees
+ * @param clampedPos - where to put the (clamped) angle
+ * @return int - pwm on time (fine counts - see PwmBackend.h)
+ */
+int Servos::anglePwm(int id, cdeg_t pos, cdeg_t *clampedPos)
+{
+    refreshTables();
+    const servoLut_t *tbl = &lut[id];
+    if (pos < tbl->lowAngle * CDEG_PER_DEG) pos = tbl->lowAngle * CDEG_PER_DEG;  // limit range
+    if (pos > tbl->highAngle * CDEG_PER_DEG) pos = tbl->highAngle * CDEG_PER_DEG;
+    *clampedPos = pos;
+
+    uint32_t ofs = pos - SERVO_LUT_MIN_ANGLE * CDEG_PER_DEG;  // never negative
+    int idx = ofs / CDEG_PER_DEG;
+    int frac = ofs % CDEG_PER_DEG;
+    int pwm = tbl->pwm[idx];
+    if (frac != 0)
+    {   // (a fraction means pos < highAngle - so idx+1 is in the table)
+        int step = (tbl->pwm[idx + 1] - pwm) * frac;
+        pwm += (step + ((step < 0) ? -CDEG_PER_DEG / 2 : CDEG_PER_DEG / 2)) / CDEG_PER_DEG;
     }
+    return (pwm);
+}
 
-    Prefs::setServoPWM(id, smin, smax);
 
-    #ifdef VERBOSE_RESPONSES
-    outStream->print("For ");           outStream->print(ServoToName(id));
-    outStream->print(" servo the ");
-    outStream->print(" MIN PWM is ");   outStream->print(smin); 
-    outStream->print(" MAX PWM is ");   outStream->println(smax);
-    #endif
-    outStream->println(OK_RESPONSE);
-    return;
+/**
+ * @brief Set the indicated servo to a position (angle +/- 90)
+ *
+ * @param id <ServoId_t>- name of servo to set
+ * @param pos desired position (in degrees... 0 +/- 90)
+ * @return true - normal.
+ * @return false - error in input (nivalidi servo id)
+ */
+bool Servos::setServoAngle(int id, int pos)
+{
+    return (setServoAngleCd(id, pos * CDEG_PER_DEG));
 }
 
 
 /**
- * @brief set the servo's Anglularlimits
- *      Note: Argcnt must be 2 or 3
- *   Format 1:  setlimits servoId minPwm maxPwm
- * @param outStream - where to send the response
- * @param tokCnt    - how many tokens?
- * @param argList   - list of pointers to tokens
+ * @brief Set the indicated servo to a position, in centidegrees
+ *
+ * @param id  - the servo
+ * @param pos - desired position (1/100 degree)
+ * @return true - normal.
+ * @return false - invalid servo id
+ */
+bool Servos::setServoAngleCd(int id, cdeg_t pos)
+{
+    if ((id < 0) || (id >= NO_OF_SERVOS))
+        return (false);
+    lock();
+    moveTo(id, pos);
+    unlock();
+    return (true);
+}
+
+
+/**
+ * @brief Set ALL servos to a new angle - a whole pose. All channels
+ *   are queued together, so they go out in the same frame burst.
+ *   (If a batch is open, the pose is staged instead)
+ * 
+ * @param angles - angle (degrees) for each servo, in servo id order
+ * @param count  - how many servos (the first 'count' ids)
+ */
+void Servos::setPose(const int *angles, int count)
+{
+    cdeg_t cdeg[NO_OF_SERVOS];
+    if (count > NO_OF_SERVOS) count = NO_OF_SERVOS;
+    for (int id = 0; id < count; id++)
+        cdeg[id] = angles[id] * CDEG_PER_DEG;
+    setPoseCd(cdeg, count);
+}
+
+
+/**
+ * @brief Set ALL servos to a new angle (centidegrees) - see setPose()
+ * 
+ * @param angles - angle (1/100 degree) for each servo, in servo id order
+ * @param count  - how many servos (the first 'count' ids)
+ */
+void Servos::setPoseCd(const cdeg_t *angles, int count)
+{
+    if (count > NO_OF_SERVOS) count = NO_OF_SERVOS;
+    lock();
+    for (int id = 0; id < count; id++)
+        moveTo(id, angles[id]);
+    unlock();
+}
+
+
+/**
+ * @brief [INTERNAL] Send a servo to an angle: at once, or (if it has a
+ *   motion profile) by making it the servo's target. If a batch is
+ *   open, the pwm (or the target) is staged - its position and wear
+ *   counters only change when the batch is committed.
+ *   (Caller must hold the lock)
+ * 
+ * @param id  - the servo (must be valid)
+ * @param pos - angle, in centidegrees
  */
-void Servos::ServoAnglelimitsCmd(Stream *outStream, int tokCnt, char *tokens[])
+void Servos::moveTo(int id, cdeg_t pos)
 {
-    int id = 0; // Decode the ID
-    id = decodeId(tokens[1]);
-    if (id < 0)
+    cdeg_t reqPos = pos;
+    int pwmVal = anglePwm(id, pos, &pos);
+    servoList_t *srv = &servoList[id];
+    if (batchDepth > 0)
     {
-    #ifdef VERBOSE_RESPONSES        
-        outStream->println("Invalid servo id");
-        #endif
-        outStream->println(ERR_RESPONSE);
+        srv->stagedAtLimit = (pos != reqPos);
+        if (srv->prof.velMax == 0)
+        {
+            writePwm(id, pwmVal);
+            srv->stagedPos = pos;
+            srv->stagedMove = true;
+        }
+        else
+        {
+            srv->prof.stagedTarget = pos;
+            srv->prof.staged = true;
+        }
         return;
     }
 
-    // put
-    int smin;
+    setAtLimit(id, (pos != reqPos), millis());
+    if (srv->prof.velMax == 0)
+        jumpTo(id, pos, pwmVal);
+    else
+        startMove(id, pos);
+}
+
+
+/**
+ * @brief [INTERNAL] Move a servo with no profile: queue its pwm, and 
+ *   it is there (as far as lastPos and wear go).  (Caller must hold 
+ *   the lock)
+ * 
+ * @param id     - the servo (must be valid)
+ * @param pos    - angle, in centidegrees (already clamped)
+ * @param pwmVal - its pwm (fine counts)
+ */
+void Servos::jumpTo(int id, cdeg_t pos, int pwmVal)
+{
+    // (for the current budget: how long it will take, at SERVO_JUMP_DPS)
+    uint64_t dist = abs(pos - servoList[id].lastPos);
+    uint64_t perTick = (uint64_t)SERVO_JUMP_DPS * CDEG_PER_DEG * framePeriodUs;
+    if (dist > 0)
+        servoList[id].jumpTicks = (dist * 1000000 + perTick - 1) / perTick;
+    writePwm(id, pwmVal);
+    trackWear(id, pos);
+    servoList[id].lastPos = pos;
+}
+
 
-    if (!Commands::decodeIntToken(outStream, "setlimit", tokens[2], -180, 180, &smin))
+/**
+ * @brief [INTERNAL] Give a profiled servo a new target. A servo already
+ *   moving keeps its speed - the profile bends toward the new target.
+ *   (Caller must hold the lock)
+ * 
+ * @param id     - the servo (must be valid)
+ * @param target - angle, in centidegrees (already clamped)
+ */
+void Servos::startMove(int id, cdeg_t target)
+{
+    profile_t *prof = &servoList[id].prof;
+    if (!prof->moving)
     {
-#ifdef VERBOSE_RESPONSES
-        outStream->println("Angle out-of-range. Must be -180 thru 180");
-#endif
-        outStream->println(ERR_RESPONSE);
+        prof->pos = servoList[id].lastPos << PROF_SHIFT;
+        prof->trapPos = prof->pos;
+        prof->vel = 0;
+        resetFilter(prof);
+        prof->started = false;
+        prof->delayTicks = 0;
+        prof->throttled = false;
     }
+    prof->target = target;
+    prof->settle = 0;
+    prof->moving = true;
+    if (!inputPending && (inputStamp != 0))
+    {   // timed from here to the first step's burst
+        pendingStamp = inputStamp;
+        inputPending = true;
+    }
+}
+
+
+/**
+ * @brief [INTERNAL] Fill the S-curve filter with the trapezoid's
+ *   position (standing still there)
+ */
+void Servos::resetFilter(profile_t *prof)
+{
+    for (int idx = 0; idx < PROF_FILTER_MAX; idx++)
+        prof->hist[idx] = prof->trapPos;
+    prof->histSum = (int64_t)prof->trapPos * prof->filterLen;
+    prof->histIdx = 0;
+}
 
-    int smax;
-    if (!Commands::decodeIntToken(outStream, "setlimit", tokens[3], -180, 180, &smax))
+
+/**
+ * @brief [INTERNAL] Advance one profile by one frame tick.
+ *   TRAPEZOID: the speed we want is the cruise speed - or less, if we
+ *   must start braking to stop at the target. Stopping from speed v, 
+ *   one tick at a time, covers v + (v-a) + (v-2a) ... = v*v/2a + v/2,
+ *   so the most we may do with d to go is (sqrt(a*a + 8*a*d) - a) / 2.
+ *   The speed then moves toward that by at most accMax.
+ *   S-CURVE: the output is the average of the last filterLen 
+ *   trapezoid positions.
+ *
+ * @param prof - the profile (moving)
+ * @return cdeg_t - the new position (centidegrees)
+ */
+cdeg_t Servos::stepProfile(profile_t *prof)
+{
+    int64_t goal = (int64_t)prof->target << PROF_SHIFT;
+    int64_t err = goal - prof->trapPos;
+    uint64_t accMax = prof->accMax;
+
+    if (err != 0)
     {
-#ifdef VERBOSE_RESPONSES
-        outStream->println("Angle out-of-range. Must be -180 thru 180");
-#endif
-        outStream->println(ERR_RESPONSE);
+        uint64_t dist = (err < 0) ? -err : err;
+        int64_t velWant = ((int64_t)isqrt(accMax * accMax + 8 * accMax * dist) - (int64_t)accMax) / 2;
+        if (velWant > prof->velCap) velWant = prof->velCap;
+        if (err < 0) velWant = -velWant;
+
+        int64_t dv = velWant - prof->vel;
+        if (dv > (int64_t)accMax) dv = accMax;
+        if (dv < -(int64_t)accMax) dv = -(int64_t)accMax;
+        prof->vel += dv;
+        prof->trapPos += prof->vel;
+
+        // Arrived (or just past it, slowly)?
+        int64_t after = goal - prof->trapPos;
+        int64_t speed = (prof->vel < 0) ? -prof->vel : prof->vel;
+        if ((after == 0) || (((after < 0) != (err < 0)) && (speed <= (int64_t)(2 * accMax))))
+        {
+            prof->trapPos = goal;
+            prof->vel = 0;
+        }
     }
-    Prefs::setServoAngles(id, smin, smax);
+    else
+        prof->vel = 0;
 
-#ifdef VERBOSE_RESPONSES
-    outStream->print("MIN angle is ");   outStream->print(smin); 
-    outStream->print(" MAX angle is ");   outStream->println(smax);    
-#endif
-    outStream->println(OK_RESPONSE);
+    // S-curve filter (with filterLen 1, this is just trapPos)
+    int len = prof->filterLen;
+    prof->histSum += prof->trapPos - prof->hist[prof->histIdx];
+    prof->hist[prof->histIdx] = prof->trapPos;
+    if (++prof->histIdx >= len)
+        prof->histIdx = 0;
+    prof->pos = prof->histSum / len;
 
-    return;
+    if (prof->trapPos == goal)
+    {   // done once the filter has caught up
+        if (++prof->settle >= len)
+        {
+            prof->pos = goal;
+            prof->moving = false;
+        }
+    }
+    else
+        prof->settle = 0;
+    return ((prof->pos + (1 << (PROF_SHIFT - 1))) >> PROF_SHIFT);
 }
 
 
 /**
- * @brief Set the position of a secific servo
- *     cmd <id> <pwm>
- *        pwm is 0..4096
- * @param outStream - where to send the response
- * @param tokCnt    - how many tokens?
- * @param argList   - list of pointers to tokens
+ * @brief [INTERNAL] Predict this tick's servo current, and throttle
+ *   moves (lowest priority first) to keep it in the budget - see 
+ *   Servos.h (CURRENT). Sets each moving servo's velCap and held.
+ *   (Caller must hold the lock)
  */
-void Servos::ServoPosCmd(Stream *outStream, int tokcnt, char **tokens)
+void Servos::scheduleCurrent()
 {
-    int id = 0; // Decode the ID
-    id = decodeId(tokens[1]);
-    if (id < 0)
+    int32_t demand[NO_OF_SERVOS];    // mA of each profiled move, at full speed
+    int32_t total = 0;
+    for (int id = 0; id < NO_OF_SERVOS; id++)
     {
-        #ifdef VERBOSE_RESPONSES
-        outStream->println("Invalid servo id");
-        #endif
-        outStream->println(ERR_RESPONSE);
+        servoList_t *srv = &servoList[id];
+        profile_t *prof = &srv->prof;
+        prof->velCap = prof->velMax;
+        prof->held = false;
+        demand[id] = 0;
+        if (srv->armed)
+            total += servoTable[id].holdMa;
+        if (srv->jumpTicks > 0)
+        {
+            total += servoTable[id].maPerDps * SERVO_JUMP_DPS;
+            srv->jumpTicks--;
+        }
+        if (prof->moving)
+        {
+            int maxVel, maxAccel, maxJerk;
+            Prefs::getServoMotion(id, &maxVel, &maxAccel, &maxJerk);
+            demand[id] = servoTable[id].maPerDps * maxVel;
+            total += demand[id];
+        }
+    }
+
+    uint32_t budget = Prefs::currentBudget();
+    if ((budget == 0) || (total <= (int32_t)budget))
         return;
+    int32_t over = total - budget;
+
+    // Stretch: cut speed caps, lowest priority first
+    int32_t cut[NO_OF_SERVOS];
+    for (int idx = 0; idx < NO_OF_SERVOS; idx++)
+    {
+        int id = prioOrder[idx];
+        cut[id] = 0;
+        if ((over <= 0) || (demand[id] == 0))
+            continue;
+        profile_t *prof = &servoList[id].prof;
+        cut[id] = demand[id] - demand[id] / THROTTLE_MAX_STRETCH;
+        if (cut[id] > over) cut[id] = over;
+        prof->velCap = prof->velMax - (int32_t)((int64_t)prof->velMax * cut[id] / demand[id]);
+        if (prof->velCap < 1) prof->velCap = 1;
+        over -= cut[id];
+        frameStats.stretchTicks++;
+        if (!prof->throttled)
+        {
+            prof->throttled = true;
+            frameStats.throttledMoves++;
+        }
     }
 
-    int reqPos;
-    int minPwm, maxPwm;
-    if (!Commands::decodeIntToken( outStream, "new position", tokens[2], 0, 4096, &reqPos))
+    // Delay: hold moves that haven't started, lowest priority first
+    uint32_t maxDelay = (uint32_t)THROTTLE_MAX_DELAY_MS * 1000 / framePeriodUs;
+    for (int idx = 0; (idx < NO_OF_SERVOS) && (over > 0); idx++)
     {
-        // Error reported by decode function - just return.
-        return;
+        int id = prioOrder[idx];
+        profile_t *prof = &servoList[id].prof;
+        if ((demand[id] == 0) || prof->started || (prof->delayTicks >= (int)maxDelay))
+            continue;
+        prof->held = true;
+        prof->delayTicks++;
+        over -= demand[id] - cut[id];
+        frameStats.delayTicks++;
+        if (cut[id] > 0)
+            frameStats.stretchTicks--;    // (held - not stretched)
+        if (!prof->throttled)
+        {
+            prof->throttled = true;
+            frameStats.throttledMoves++;
+        }
     }
+    if (over > 0)
+        frameStats.overBudget++;
+}
 
-    Prefs::getServoPWM(id, &minPwm, &maxPwm); 
-    if (reqPos < minPwm) reqPos=minPwm;
-    if (reqPos > maxPwm) reqPos=maxPwm;
-    hw716.setPWM(id, 0, reqPos);
 
-    #ifdef VERBOSE_RESPONSES
-    outStream->print("position set to "); outStream->println(reqPos);
-    #endif
-    outStream->println(OK_RESPONSE);
+/**
+ * @brief [INTERNAL] Turn a servo's channel off if it has been idle for
+ *   its idle time (see Servos.h - IDLE).  (Caller must hold the lock)
+ * 
+ * @param id  - the servo
+ * @param now - millis()
+ */
+void Servos::checkIdle(int id, uint32_t now)
+{
+    servoList_t *srv = &servoList[id];
+    uint32_t idleSecs = Prefs::getServoIdle(id);
+    if (!srv->armed || (idleSecs == 0) || srv->dirty || srv->staged || srv->prof.moving || srv->prof.staged)
+        return;
+    if ((now - srv->lastActive) < idleSecs * 1000)
+        return;
+
+    srv->energisedMs += now - srv->armedSince;
+    setAtLimit(id, false, now);
+    srv->wearChanged = true;
+    srv->armed = false;
+    srv->idleOffs++;
+    srv->pwm = 0;        // full off (lastPos is kept)
+    srv->dirty = true;
+}
+
+
+/**
+ * @brief [INTERNAL] Wear: count the travel (and any reversal) of a 
+ *   move from lastPos to pos.  (Caller must hold the lock)
+ * 
+ * @param id  - the servo
+ * @param pos - its new position (centidegrees)
+ */
+void Servos::trackWear(int id, cdeg_t pos)
+{
+    servoList_t *srv = &servoList[id];
+    cdeg_t delta = pos - srv->lastPos;
+    if (delta == 0)
+        return;
+    int8_t dir = (delta > 0) ? 1 : -1;
+    if ((srv->lastDir != 0) && (dir != srv->lastDir))
+        srv->reversals++;
+    srv->lastDir = dir;
+    srv->travelCdeg += (delta > 0) ? delta : -delta;
+    srv->wearChanged = true;
+}
+
+
+/**
+ * @brief [INTERNAL] Wear: a servo is (or isn't) held at a limit - time
+ *   it.  (Caller must hold the lock)
+ * 
+ * @param id      - the servo
+ * @param atLimit - true if its last command was clamped
+ * @param now     - millis()
+ */
+void Servos::setAtLimit(int id, bool atLimit, uint32_t now)
+{
+    servoList_t *srv = &servoList[id];
+    if (atLimit == srv->atLimit)
+        return;
+    if (atLimit)
+        srv->limitSince = now;
+    else
+        srv->limitMs += now - srv->limitSince;
+    srv->atLimit = atLimit;
+    srv->wearChanged = true;
 }
 
+
+/**
+ * @brief [INTERNAL] A servo's wear counters, up to now.
+ *   (Caller must hold the lock)
+ */
+void Servos::getWear(int id, wear_t *wear, uint32_t now)
+{
+    const servoList_t *srv = &servoList[id];
+    memset(wear, 0, sizeof(wear_t));
+    wear->travelCdeg = srv->travelCdeg;
+    wear->reversals = srv->reversals;
+    wear->limitMs = srv->limitMs + (srv->atLimit ? (now - srv->limitSince) : 0);
+    wear->energisedMs = srv->energisedMs + (srv->armed ? (now - srv->armedSince) : 0);
+}
+
+
+/**
+ * @brief [INTERNAL] Pick up the wear counters from the last save
+ */
+void Servos::loadWear()
+{
+    for (int id = 0; id < NO_OF_SERVOS; id++)
+    {
+        wear_t wear;
+        if (Prefs::getWear(id, &wear, sizeof(wear)) != sizeof(wear))
+            continue;
+        lock();
+        servoList[id].travelCdeg = wear.travelCdeg;
+        servoList[id].reversals = wear.reversals;
+        servoList[id].limitMs = wear.limitMs;
+        servoList[id].energisedMs = wear.energisedMs;
+        unlock();
+    }
+}
+
+
+/**
+ * @brief [INTERNAL] Save the wear counters of every servo whose 
+ *   counters changed (one on, or at a limit, always has). The flash
+ *   writes are done without the lock.
+ */
+void Servos::saveWear()
+{
+    uint32_t now = millis();
+    for (int id = 0; id < NO_OF_SERVOS; id++)
+    {
+        wear_t wear;
+        lock();
+        servoList_t *srv = &servoList[id];
+        bool changed = (srv->wearChanged || srv->armed || srv->atLimit);
+        srv->wearChanged = false;
+        getWear(id, &wear, now);
+        unlock();
+        if (changed)
+            Prefs::putWear(id, &wear, sizeof(wear));
+    }
+}
+
+
+/**
+ * @brief Call from loop() - saves the wear counters every WEAR_SAVE_SECS
+ *   (on the loop task, so no servo task ever waits on the flash)
+ */
+void Servos::loop()
+{
+    if ((millis() - lastWearSave) < WEAR_SAVE_SECS * 1000UL)
+        return;
+    lastWearSave = millis();
+    saveWear();
+}
+
+
+/**
+ * @brief [INTERNAL] Frame tick: step every moving servo along its
+ *   profile, and queue its new position for this frame. Turn off any
+ *   that have been idle too long.
+ *   (Steps are never staged - a batch only holds new targets)
+ */
+void Servos::stepProfiles()
+{
+    uint32_t now = millis();
+    lock();
+    refreshTables();
+    scheduleCurrent();
+    for (int id = 0; id < NO_OF_SERVOS; id++)
+    {
+        profile_t *prof = &servoList[id].prof;
+        if (!prof->moving)
+        {
+            checkIdle(id, now);
+            continue;
+        }
+        if (prof->held)
+            continue;
+        prof->started = true;
+        cdeg_t pos = stepProfile(prof);
+        queuePwm(id, anglePwm(id, pos, &pos));
+        trackWear(id, pos);
+        servoList[id].lastPos = pos;
+    }
+    unlock();
+}
+
+
+/**
+ * @brief [INTERNAL] Queue a pwm value for the next frame - or stage
+ *   it, if a batch is open. (Caller must hold the lock)
+ *   A value that replaces one still waiting for its frame is a
+ *   'coalesced' write - it never costs any I2C time. A value within
+ *   the deadband of the programmed value is 'suppressed' - dropped.
+ *   (Except 0 - full off - which is always sent)
+ * 
+ * @param id     - the servo
+ * @param pwmVal - pwm on time (fine counts)
+ */
+void Servos::writePwm(int id, int pwmVal)
+{
+    if (batchDepth > 0)
+    {
+        servoList[id].stagedPwm = pwmVal;
+        servoList[id].staged = true;
+        servoList[id].stagedMove = false;   // (raw pwm - moveTo() sets it after)
+        return;
+    }
+    queuePwm(id, pwmVal);
+}
+
+
+/**
+ * @brief [INTERNAL] Queue a pwm value for the next frame (never staged).
+ *   (Caller must hold the lock)
+ * 
+ * @param id     - the servo
+ * @param pwmVal - pwm on time (fine counts)
+ */
+void Servos::queuePwm(int id, int pwmVal)
+{
+    frameStats.writes++;
+    servoList[id].lastActive = millis();
+    if (!servoList[id].armed)
+    {   // (back) on
+        servoList[id].armed = true;
+        servoList[id].armedSince = servoList[id].lastActive;
+    }
+    int hwPwm = servoList[id].hwPwm;
+    if ((hwPwm >= 0) && (pwmVal != 0) && (abs(pwmVal - hwPwm) <= toFine(id, Prefs::getServoDeadband(id))))
+    {   // Close enough to what's programmed - stay there (and drop anything pending)
+        frameStats.suppressed++;
+        servoList[id].pwm = hwPwm;
+        servoList[id].dirty = false;
+        return;
+    }
+
+    if (servoList[id].dirty)
+        frameStats.coalesced++;
+    servoList[id].pwm = pwmVal;
+    servoList[id].dirty = true;
+    if (!inputPending && (inputStamp != 0))
+    {   // oldest input waiting for this frame
+        pendingStamp = inputStamp;
+        inputPending = true;
+    }
+}
+
+
+/**
+ * @brief Tell us when the input that the current task is working on
+ *   arrived (Stats::now()). Servo writes from this task are timed 
+ *   from then until their frame burst is on the wire. 0 means none.
+ * 
+ * @param stamp 
+ */
+void Servos::setInputStamp(uint32_t stamp)
+{
+    inputStamp = stamp;
+}
+
+
+/**
+ * @brief [INTERNAL] Frame timer callback (esp_timer task) - wake the
+ *   frame task.
+ */
+void Servos::frameTick(void *arg)
+{
+    xTaskNotifyGive(frameTask);
+}
+
+
+/**
+ * @brief [INTERNAL] Frame task - once per PWM frame, flush.
+ */
+void Servos::frameLoop(void *param)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        stepProfiles();
+        flushFrame();
+    }
+}
+
+
+/**
+ * @brief [INTERNAL] Send every channel that changed since the last 
+ *   frame - ONE burst per board (first to last changed channel - the
+ *   ones in between are re-sent with their current values).
+ *   The values are copied with the lock held, so a batch commit is
+ *   never split across frames. The bursts are handed to the boards without it.
+ */
+void Servos::flushFrame()
+{
+    int vals[NO_OF_BOARDS][CHANNELS_PER_BOARD];
+    int first[NO_OF_BOARDS];
+    int last[NO_OF_BOARDS];
+    bool due[NO_OF_BOARDS];
+    bool held = false;    // a dirty channel waits for its board's frame
+    bool timed;
+    uint32_t inStamp;
+
+    lock();
+    frameStats.frames++;
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+        first[board] = CHANNELS_PER_BOARD;
+        last[board] = -1;
+        due[board] = ((frameStats.frames % frameDiv[board]) == 0);
+    }
+    for (int id = 0; id < NO_OF_SERVOS; id++)
+    {
+        int board = servoTable[id].board;
+        int chan = servoTable[id].channel;
+        vals[board][chan] = servoList[id].pwm;
+        if (!servoList[id].dirty)
+            continue;
+        if (!due[board])
+        {
+            held = true;
+            continue;
+        }
+        servoList[id].dirty = false;
+        if (chan < first[board]) first[board] = chan;
+        if (chan > last[board]) last[board] = chan;
+    }
+    for (int id = 0; id < NO_OF_SERVOS; id++)
+    {   // everything in a burst will be programmed
+        int board = servoTable[id].board;
+        int chan = servoTable[id].channel;
+        if ((chan >= first[board]) && (chan <= last[board]))
+            servoList[id].hwPwm = vals[board][chan];
+    }
+    timed = inputPending && !held;
+    inStamp = pendingStamp;
+    if (timed)
+        inputPending = false;
+    unlock();
+
+    // One burst per run of channels we own.  (The input stamp goes
+    //   with the frame's last burst)
+    struct { int board, first, last; } runs[NO_OF_BOARDS * CHANNELS_PER_BOARD / 2 + 1];
+    int noOfRuns = 0;
+    for (int board = 0; board < NO_OF_BOARDS; board++)
+    {
+        int chan = first[board];
+        while (chan <= last[board])
+        {
+            if (chanMap[board][chan] < 0)
+            {
+                chan++;
+                continue;
+            }
+            int runEnd = chan;
+            while ((runEnd < last[board]) && (chanMap[board][runEnd + 1] >= 0))
+                runEnd++;
+            runs[noOfRuns].board = board;
+            runs[noOfRuns].first = chan;
+            runs[noOfRuns].last = runEnd;
+            noOfRuns++;
+            chan = runEnd + 1;
+        }
+    }
+
+    for (int run = 0; run < noOfRuns; run++)
+    {
+        bool lastRun = (run == noOfRuns - 1);
+        pwmBurst_t burst;
+        burst.board = runs[run].board;
+        burst.first = runs[run].first;
+        burst.last = runs[run].last;
+        burst.stamp = (lastRun && timed) ? inStamp : 0;
+        frameStats.bursts++;
+        boards[burst.board]->write(&burst, vals[burst.board]);
+    }
+}
+
+
+/**
+ * @brief [INTERNAL] A burst finished (called by its backend - on the
+ *   I2C bus task, for an HW716). If it failed, its channels are sent
+ *   again next frame.
+ * 
+ * @param burst - the burst
+ * @param ok    - true if it was written
+ */
+void Servos::burstDone(const pwmBurst_t *burst, bool ok)
+{
+    uint32_t end = Stats::now();
+    Stats::add(&burstTime, burst->queued, end, ok);
+    if (ok)
+    {
+        if (burst->stamp != 0)
+            Stats::stage(STAGE_IN_PWM, burst->stamp, end);
+        return;
+    }
+
+    lock();
+    for (int chan = burst->first; chan <= burst->last; chan++)
+    {
+        int id = chanMap[burst->board][chan];
+        if (id < 0)
+            continue;
+        servoList[id].hwPwm = -1;    // don't know what it is now
+        servoList[id].dirty = true;
+    }
+    unlock();
+}
+
+
+/**
+ * @brief Start a batch. Servo writes are staged until the
+ *   matching commitBatch().
+ */
+void Servos::beginBatch()
+{
+    lock();
+    batchDepth++;
+    unlock();
+}
+
+
+/**
+ * @brief End a batch. When the outermost batch ends, every staged
+ *   servo is queued at once - so they all go in the same frame burst.
+ * 
+ * @return true  - normal
+ * @return false - no batch was open
+ */
+bool Servos::commitBatch()
+{
+    lock();
+    if (batchDepth <= 0)
+    {
+        unlock();
+        return (false);
+    }
+
+    if (--batchDepth == 0)
+    {
+        uint32_t now = millis();
+        for (int id = 0; id < NO_OF_SERVOS; id++)
+        {
+            servoList_t *srv = &servoList[id];
+            if (srv->prof.staged)
+            {
+                srv->prof.staged = false;
+                setAtLimit(id, srv->stagedAtLimit, now);
+                startMove(id, srv->prof.stagedTarget);
+            }
+            if (!srv->staged)
+                continue;
+            srv->staged = false;
+            if (srv->stagedMove)
+            {
+                srv->stagedMove = false;
+                setAtLimit(id, srv->stagedAtLimit, now);
+                jumpTo(id, srv->stagedPos, srv->stagedPwm);
+            }
+            else
+                writePwm(id, srv->stagedPwm);
+        }
+    }
+    unlock();
+    return (true);
+}
+
+
+/**
+ * @brief Print the frame scheduler stats (for the 'stats' command)
+ * 
+ * @param outStream - where to send them
+ */
+void Servos::printStats(Stream *outStream)
+{
+    frameStats_t counts;
+    Histogram burst;
+    lock();
+    counts = frameStats;
+    unlock();
+    portENTER_CRITICAL(&Stats::statMux);
+    burst = burstTime;
+    portEXIT_CRITICAL(&Stats::statMux);
+
+    ResponseBuf::printTo(outStream, "frames: %u (%u us)  bursts: %u  servo writes: %u  coalesced: %u  suppressed: %u\r\n",
+                                    counts.frames, framePeriodUs, counts.bursts, counts.writes, counts.coalesced, counts.suppressed);
+    if (counts.clipped != 0)
+        ResponseBuf::printTo(outStream, "pulses cut to the pwm period: %u (see 'refresh')\r\n", counts.clipped);
+    ResponseBuf::printTo(outStream, "throttled moves: %u  stretched: %u ms  delayed: %u ms  over budget: %u frames\r\n",
+                                    counts.throttledMoves, (uint32_t)((uint64_t)counts.stretchTicks * framePeriodUs / 1000),
+                                    (uint32_t)((uint64_t)counts.delayTicks * framePeriodUs / 1000), counts.overBudget);
+    burst.print(outStream, "i2c-burst");
+    I2cBus::printStats(outStream);
+}
+
+
+void Servos::resetStats()
+{
+    lock();
+    memset(&frameStats, 0, sizeof(frameStats));
+    unlock();
+    portENTER_CRITICAL(&Stats::statMux);
+    burstTime.reset();
+    portEXIT_CRITICAL(&Stats::statMux);
+    I2cBus::resetStats();
+}
+
+
+/**
+ * @brief Return the current position of the microcontroller
+ *
+ * @param id - the ID of the servo. ONLY SINGLE SERVOS ARE ACCEPTED!
+ * @return int The current angle (in degrees 0 +/- 90 - rounded). 
+ *        INT_MAX if servo-id is invalid.
+ */
+int Servos::getServoAngle(int id)
+{
+    cdeg_t pos = getServoAngleCd(id);
+    if (pos == INT_MAX)
+        return (INT_MAX);
+    return ((pos + ((pos < 0) ? -CDEG_PER_DEG / 2 : CDEG_PER_DEG / 2)) / CDEG_PER_DEG);
+}
+
+
+/**
+ * @brief Return the current position, in centidegrees
+ *
+ * @param id - the ID of the servo.
+ * @return cdeg_t The current angle (1/100 degree). INT_MAX if servo-id is invalid.
+ */
+cdeg_t Servos::getServoAngleCd(int id)
+{
+    if ((id < 0) || (id >= NO_OF_SERVOS))
+        return (INT_MAX);
+    return(servoList[id].lastPos);
+}
+
+
+/**
+ * @brief set the servo's PWM limits 
+ *      <setpwm <servoID> <min> <max>  
+ *       min and max range 0...4096
+ * @param outStream - where to send the response
+ * @param args      - servo, min, max (range checked by the dispatcher)
+ * @return true  - normal
+ * @return false - min is not below max
+ */
+bool Servos::ServoSetPwmlimitsExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int id = args->val[0];
+    int smin = args->val[1];
+    int smax = args->val[2];
+
+    if (smin >=smax)
+    { 
+        #ifdef VERBOSE_RESPONSES
+        outStream->println("Invalid range - min is greater than (or equal to) max");
+        ResponseBuf::printTo(outStream, "Values are %d %d\r\n", smin, smax);
+        #endif
+        return (false);
+    }
+
+    int board = servoTable[id].board;
+    int hz = max((int)boardHz[board], Prefs::getBoardRefresh(board));
+    if (smax * hz >= 4096 * SERVO_PWM_FREQ)
+    {
+        #ifdef VERBOSE_RESPONSES
+        ResponseBuf::printTo(outStream, "A %d count pulse does not fit board %d's %d Hz period\r\n", smax, board, hz);
+        #endif
+        return (false);
+    }
+
+    Prefs::setServoPWM(id, smin, smax);
+
+    #ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "For %s servo the  MIN PWM is %d MAX PWM is %d\r\n", ServoToName(id).c_str(), smin, smax);
+    #endif
+    return (true);
+}
+
+
+/**
+ * @brief set the servo's Anglularlimits
+ *   Format:  setAngle servoId minAngle maxAngle
+ * @param outStream - where to send the response
+ * @param args      - servo, min, max (range checked by the dispatcher)
+ * @return true  - normal
+ */
+bool Servos::ServoAnglelimitsExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int smin = args->val[1];
+    int smax = args->val[2];
+    Prefs::setServoAngles(args->val[0], smin, smax);
+
+#ifdef VERBOSE_RESPONSES
+    outStream->print("MIN angle is ");   outStream->print(smin); 
+    outStream->print(" MAX angle is ");   outStream->println(smax);    
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Add (or replace) a calibration point
+ *     calpoint <servo> <angle> <pwm>
+ * @param outStream - where to send the response
+ * @param args      - servo, angle, pwm (range checked by the dispatcher)
+ * @return true  - normal
+ * @return false - no room for another point
+ */
+bool Servos::calPointExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int id = args->val[0];
+    if (!Prefs::setServoCalPoint(id, args->val[1], args->val[2]))
+    {
+#ifdef VERBOSE_RESPONSES
+        ResponseBuf::printTo(outStream, "%s already has %d calibration points\r\n", ServoToName(id).c_str(), CAL_MAX_POINTS);
+#endif
+        return (false);
+    }
+
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "%s: %d degrees is PWM %d\r\n", ServoToName(id).c_str(), args->val[1], args->val[2]);
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Remove a servo's calibration points
+ *     calclear <servo>
+ * @param outStream - where to send the response
+ * @param args      - servo
+ * @return true  - normal
+ */
+bool Servos::calClearExec(Stream *outStream, const cmdArgs_t *args)
+{
+    Prefs::clearServoCal(args->val[0]);
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "%s calibration cleared\r\n", ServoToName(args->val[0]).c_str());
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief get (or set) a servo's motion limits. Any limit not given is 
+ *   left as it is.
+ *     motion <servo> [<velocity> [<acceleration> [<jerk>]]]
+ * @param outStream - where to send the response
+ * @param args      - servo, [limits] (range checked by the dispatcher)
+ * @return true  - normal
+ */
+bool Servos::motionExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int id = args->val[0];
+    int limit[3];
+    Prefs::getServoMotion(id, &limit[0], &limit[1], &limit[2]);
+    if (args->argCnt > 1)
+    {
+        for (int idx = 1; idx < args->argCnt; idx++)
+            limit[idx - 1] = args->val[idx];
+        Prefs::setServoMotion(id, limit[0], limit[1], limit[2]);
+    }
+
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "%s: max %d deg/s, %d deg/s/s, jerk %d deg/s/s/s (%s)\r\n", ServoToName(id).c_str(),
+                                    limit[0], limit[1], limit[2], (limit[0] == 0) ? "no profile" : (limit[2] == 0) ? "trapezoid" : "S-curve");
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief get (or set) a servo's deadband
+ *     deadband <servo> [<counts>]
+ * @param outStream - where to send the response
+ * @param args      - servo, [counts] (range checked by the dispatcher)
+ * @return true  - normal
+ */
+bool Servos::deadbandExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int id = args->val[0];
+    if (args->argCnt == 2)
+        Prefs::setServoDeadband(id, args->val[1]);
+
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "%s deadband is %d pwm counts\r\n", ServoToName(id).c_str(), Prefs::getServoDeadband(id));
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Get/set a board's pwm refresh rate (Prefs)
+ *     refresh <board>          show it
+ *     refresh <board> <hz>     set it - used after the next reboot
+ *   A rate too fast for the longest pulse of a servo on the board
+ *   (see maxRefresh()) is refused.
+ *   (DONT forget to COMMIT your change!)
+ *
+ * @param outStream - where to send the result
+ * @param args      - board [, hz]  (range checked by the dispatcher)
+ * @return true     - normal
+ * @return false    - the servos' pulses don't fit that rate's period
+ */
+bool Servos::refreshExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int board = args->val[0];
+    if (args->argCnt == 2)
+    {
+        if (args->val[1] > maxRefresh(board))
+        {
+#ifdef VERBOSE_RESPONSES
+            ResponseBuf::printTo(outStream, "board %d: a %d count pulse does not fit a %d Hz period - %d Hz max (lower the servos' pwm limits first)\r\n",
+                                            board, maxPulse(board), args->val[1], maxRefresh(board));
+#endif
+            return (false);
+        }
+        Prefs::setBoardRefresh(board, args->val[1]);
+    }
+
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "board %d refresh: %d Hz now, %d Hz after reboot (frame %u us, every %d frames)\r\n",
+                                    board, boardHz[board], Prefs::getBoardRefresh(board), framePeriodUs, frameDiv[board]);
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Get/set a servo's idle time (see Servos.h - IDLE), and show
+ *   its energised time.
+ *     idle <servo>           show it
+ *     idle <servo> <secs>    set it (0: never turn off)
+ *
+ * @param outStream - where to send the result
+ * @param args      - servo [, secs]  (range checked by the dispatcher)
+ * @return true     - always
+ */
+bool Servos::idleExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int id = args->val[0];
+    if (args->argCnt == 2)
+        Prefs::setServoIdle(id, args->val[1]);
+
+#ifdef VERBOSE_RESPONSES
+    lock();
+    uint32_t now = millis();
+    bool armed = servoList[id].armed;
+    uint64_t onMs = servoList[id].energisedMs + (armed ? (now - servoList[id].armedSince) : 0);
+    uint32_t offs = servoList[id].idleOffs;
+    unlock();
+    ResponseBuf::printTo(outStream, "%s idle time %d secs - %s, energised %u.%03u secs, turned off %u times\r\n",
+                                    ServoToName(id).c_str(), Prefs::getServoIdle(id), armed ? "on" : "off",
+                                    (uint32_t)(onMs / 1000), (uint32_t)(onMs % 1000), offs);
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Get/set the servo current budget (Prefs - see Servos.h - CURRENT)
+ *     budget          show it
+ *     budget <mA>     set it (0: no limit)
+ *
+ * @param outStream - where to send the result
+ * @param args      - [mA]  (range checked by the dispatcher)
+ * @return true     - always
+ */
+bool Servos::budgetExec(Stream *outStream, const cmdArgs_t *args)
+{
+    if (args->argCnt == 1)
+        Prefs::currentBudget(args->val[0]);
+
+#ifdef VERBOSE_RESPONSES
+    ResponseBuf::printTo(outStream, "servo current budget: %u mA%s\r\n", Prefs::currentBudget(),
+                                    (Prefs::currentBudget() == 0) ? " (no limit)" : "");
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Show a servo's wear counters (or every servo's)
+ *     wear                   all servos
+ *     wear <servo>           one servo
+ *     wear <servo> reset     zero its counters (new servo) - saved at once
+ *
+ * @param outStream - where to send the result
+ * @param args      - [servo [reset]]
+ * @return true     - normal
+ * @return false    - second arg isn't 'reset'
+ */
+bool Servos::wearExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int first = 0;
+    int last = NO_OF_SERVOS - 1;
+    if (args->argCnt >= 1)
+        first = last = args->val[0];
+
+    if (args->argCnt == 2)
+    {
+        if (0 != strcasecmp(args->tokens[2], "reset"))
+        {
+#ifdef VERBOSE_RESPONSES
+            ResponseBuf::printTo(outStream, "Expected 'reset' - not %s\r\n", args->tokens[2]);
+#endif
+            return (false);
+        }
+        wear_t wear;
+        lock();
+        servoList_t *srv = &servoList[first];
+        srv->travelCdeg = 0;
+        srv->reversals = 0;
+        srv->lastDir = 0;
+        srv->limitMs = 0;
+        srv->limitSince = millis();
+        srv->energisedMs = 0;
+        srv->armedSince = srv->limitSince;
+        srv->wearChanged = false;
+        getWear(first, &wear, srv->limitSince);
+        unlock();
+        Prefs::putWear(first, &wear, sizeof(wear));
+    }
+
+#ifdef VERBOSE_RESPONSES
+    uint32_t now = millis();
+    for (int id = first; id <= last; id++)
+    {
+        wear_t wear;
+        lock();
+        getWear(id, &wear, now);
+        unlock();
+        ResponseBuf::printTo(outStream, "%-6s travel %u deg  reversals %u  at limit %u secs  energised %u secs\r\n",
+                                        ServoToName(id).c_str(), (uint32_t)(wear.travelCdeg / CDEG_PER_DEG), wear.reversals,
+                                        (uint32_t)(wear.limitMs / 1000), (uint32_t)(wear.energisedMs / 1000));
+    }
+#endif
+    return (true);
+}
+
+
+/**
+ * @brief Set the position of a specific servo
+ *     servo <id> <pwm>     (also the binary OP_SERVO frame)
+ *        pwm is 0..4096
+ * @param outStream - where to send any text
+ * @param args      - val[0] is the servo id, val[1] is the pwm (0..4096)
+ * @return true  - normal
+ * @return false - invalid servo id
+ */
+bool Servos::ServoPosExec(Stream *outStream, const cmdArgs_t *args)
+{
+    int id = args->val[0];
+    int reqPos = args->val[1];
+    int minPwm, maxPwm;
+
+    if ((id < 0) || (id >= NO_OF_SERVOS))
+        return (false);
+
+    Prefs::getServoPWM(id, &minPwm, &maxPwm); 
+    if (reqPos < minPwm) reqPos=minPwm;
+    if (reqPos > maxPwm) reqPos=maxPwm;
+    lock();
+    servoList[id].prof.moving = false;   // raw pwm overrides any profile
+    servoList[id].prof.staged = false;
+    writePwm(id, toFine(id, reqPos));
+    unlock();
+
+    #ifdef VERBOSE_RESPONSES
+    outStream->print("position set to "); outStream->println(reqPos);
+    #endif
+    return (true);
+}
+
+
+/**
+ * @brief Move one servo to an angle
+ *     angle <servo> <degrees>     (also the binary OP_ANGLE frame)
+ * @param outStream - where to send any text
+ * @param args      - val[0] is the servo id, val[1] the angle (centidegrees)
+ * @return true  - normal
+ */
+bool Servos::angleExec(Stream *outStream, const cmdArgs_t *args)
+{
+    return (setServoAngleCd(args->val[0], args->val[1]));
+}
+
+
+/**
+ * @brief Set the head servos (the first POSE_SERVOS) to a new angle
+ *     setpoint <angle0> ... <angleN>   (in servo id order)
+ *     Also the binary OP_SETPOINT frame.
+ * @param outStream - where to send any text
+ * @param args      - val[id] is the angle (centidegrees) for each servo
+ * @return true  - normal
+ * @return false - wrong number of angles
+ */
+bool Servos::setpointExec(Stream *outStream, const cmdArgs_t *args)
+{
+    if (args->argCnt != POSE_SERVOS)
+        return (false);
+
+    cdeg_t angles[POSE_SERVOS];
+    for (int id = 0; id < POSE_SERVOS; id++)
+        angles[id] = args->val[id];
+    setPoseCd(angles, POSE_SERVOS);   // all servos move together
+    return (true);
+}
+
+
+/**
+ * @brief Start a batch  (begin)
+ * 
+ * @param outStream - where to send any text
+ * @param args      - (none)
+ * @return true  - always
+ */
+bool Servos::beginExec(Stream *outStream, const cmdArgs_t *args)
+{
+    beginBatch();
+    return (true);
+}
+
+
+/**
+ * @brief End a batch, and send the staged servo changes  (end)
+ * 
+ * @param outStream - where to send any text
+ * @param args      - (none)
+ * @return true  - normal
+ * @return false - no batch was open
+ */
+bool Servos::endExec(Stream *outStream, const cmdArgs_t *args)
+{
+    if (!commitBatch())
+    {
+        #ifdef VERBOSE_RESPONSES
+        outStream->println("'end' without 'begin'");
+        #endif
+        return (false);
+    }
+    return (true);
+}
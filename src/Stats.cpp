@@ -0,0 +1,130 @@
+/**
+ * @file Stats.cpp
+ * @author Doug Fajardo
+ * @brief  Latency counters and log2 histograms.
+ * @version 0.1
+ * @date 2024-09-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "Config.h"
+#include "Stats.h"
+#include "ResponseBuf.h"
+
+/* STATIC DECLARATIONS */
+Histogram Stats::stages[NO_OF_STAGES];
+portMUX_TYPE Stats::statMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *stageNames[NO_OF_STAGES] = {"rx-eol", "eol-run", "handler", "in-pwm"};
+
+
+/**
+ * @brief Add one sample.  (Caller must hold Stats::statMux)
+ *
+ * @param us  - the sample, in microseconds
+ * @param ok  - false to count it as an error, too
+ */
+void Histogram::add(uint32_t us, bool ok)
+{
+  int idx = 0;
+  for (uint32_t val = us >> 1; (val != 0) && (idx < STATS_BUCKETS - 1); val >>= 1)
+    idx++;
+
+  bucket[idx]++;
+  count++;
+  if (!ok) errors++;
+  totalUs += us;
+  if (us > maxUs) maxUs = us;
+}
+
+
+void Histogram::reset()
+{
+  memset(this, 0, sizeof(Histogram));
+}
+
+
+/**
+ * @brief Print one line:  label count errors avg max, then each
+ *   non-empty bucket as <upper limit in us>:<count>
+ *
+ * @param outStream - where to send it
+ * @param label     - name for this line
+ */
+void Histogram::print(Stream *outStream, const char *label)
+{
+  ResponseBuf::printTo(outStream, "%-10s n=%-6u err=%-4u avg=%-6u max=%-7u |", label, count, errors,
+                                  (count > 0) ? (totalUs / count) : 0, maxUs);
+  for (int idx = 0; idx < STATS_BUCKETS; idx++)
+  {
+    if (bucket[idx] == 0)
+      continue;
+    if (idx == STATS_BUCKETS - 1)
+      ResponseBuf::printTo(outStream, " >=%u:%u", 1u << idx, bucket[idx]);
+    else
+      ResponseBuf::printTo(outStream, " <%u:%u", 2u << idx, bucket[idx]);
+  }
+  outStream->println();
+}
+
+
+/**
+ * @brief Run time setup
+ */
+void Stats::begin()
+{
+  resetStages();
+}
+
+
+/**
+ * @brief Add the interval between two timestamps to a histogram
+ *
+ * @param hist         - the histogram
+ * @param startUs  - Stats::now() at the start
+ * @param endUs    - Stats::now() at the end
+ * @param ok           - false to count it as an error, too
+ */
+void Stats::add(Histogram *hist, uint32_t startUs, uint32_t endUs, bool ok)
+{
+  uint32_t us = endUs - startUs;
+  portENTER_CRITICAL(&statMux);
+  hist->add(us, ok);
+  portEXIT_CRITICAL(&statMux);
+}
+
+
+/**
+ * @brief Add an interval to one of the pipeline stages
+ *
+ * @param stage        - which stage
+ * @param startUs  - Stats::now() at the start
+ * @param endUs    - Stats::now() at the end
+ */
+void Stats::stage(statStage_t stage, uint32_t startUs, uint32_t endUs)
+{
+  add(&stages[stage], startUs, endUs, true);
+}
+
+
+void Stats::printStages(Stream *outStream)
+{
+  for (int idx = 0; idx < NO_OF_STAGES; idx++)
+  {
+    Histogram copy;
+    portENTER_CRITICAL(&statMux);
+    copy = stages[idx];
+    portEXIT_CRITICAL(&statMux);
+    copy.print(outStream, stageNames[idx]);
+  }
+}
+
+
+void Stats::resetStages()
+{
+  portENTER_CRITICAL(&statMux);
+  for (int idx = 0; idx < NO_OF_STAGES; idx++)
+    stages[idx].reset();
+  portEXIT_CRITICAL(&statMux);
+}
@@ -0,0 +1,139 @@
+/**
+ * @file Tokenizer.cpp
+ * @author Doug Fajardo
+ * @brief  Split command lines into tokens, in place
+ * @version 0.1
+ * @date 2024-09-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <string.h>
+#include "Tokenizer.h"
+
+
+/**
+ * @brief Split a line into tokens, IN PLACE.
+ *   Each token is NUL-terminated inside 'line', and 'tokens' gets a
+ *   pointer to it - nothing is copied. A token that starts with a quote
+ *   runs to the matching quote (or end-of-line), so it may contain
+ *   separators.
+ *   There is no static state, so any number of sessions (on any
+ *   number of tasks) may tokenize at the same time.
+ * 
+ * @param line      - the line to split. It is modified!
+ * @param tokens    - where to put the pointers to each token
+ * @param maxTokens - size of 'tokens'. Extra tokens are ignored.
+ * @return int      - the number of tokens found (0 for a blank line)
+ */
+int Tokenizer::tokenize(char *line, char **tokens, int maxTokens)
+{
+  int tokCnt = 0;
+  char *src = line;
+
+  while (tokCnt < maxTokens)
+  {
+    while ((*src != '\0') && (strchr(SEPARATOR, *src) != nullptr))
+      src++;   // skip leading separators
+    if (*src == '\0')
+      break;
+
+    if (strchr(QUOTES, *src) != nullptr)
+    { // quoted - runs to the matching quote
+      char quote = *src++;
+      tokens[tokCnt++] = src;
+      while ((*src != '\0') && (*src != quote))
+        src++;
+    }
+    else
+    {
+      tokens[tokCnt++] = src;
+      while ((*src != '\0') && (strchr(SEPARATOR, *src) == nullptr))
+        src++;
+    }
+
+    if (*src == '\0')
+      break;
+    *src++ = '\0';  // terminate this token
+  }
+  return (tokCnt);
+}
+
+
+/**
+ * @brief Split a line into separate commands (at CMD_SEPARATOR), IN PLACE.
+ *   A separator inside quotes does not count.
+ * 
+ * @param line    - the line to split. It is modified!
+ * @param cmds    - where to put the pointer to each command
+ * @param maxCmds - size of 'cmds'. The last one gets whatever is left.
+ * @return int    - the number of commands (1 or more)
+ */
+int Tokenizer::splitLine(char *line, char **cmds, int maxCmds)
+{
+  int cmdCnt = 1;
+  char quote = '\0';
+  cmds[0] = line;
+
+  for (char *src = line; (*src != '\0') && (cmdCnt < maxCmds); src++)
+  {
+    if (quote != '\0')
+    {
+      if (*src == quote) quote = '\0';
+    }
+    else if (strchr(QUOTES, *src) != nullptr)
+    {
+      quote = *src;
+    }
+    else if (*src == CMD_SEPARATOR)
+    {
+      *src = '\0';
+      cmds[cmdCnt++] = src + 1;
+    }
+  }
+  return (cmdCnt);
+}
+
+
+/**
+ * @brief Decode decimal degrees ("-12", "7.5", "45.25") to
+ *   centidegrees - integer math only. Digits past the second decimal
+ *   place are dropped.
+ * 
+ * @param token - the text
+ * @param val   - where to put the result (centidegrees)
+ * @return true  - decoded
+ * @return false - not a number
+ */
+bool Tokenizer::decodeCdeg(const char *token, long *val)
+{
+  const char *ptr = token;
+  bool neg = (*ptr == '-');
+  if ((*ptr == '-') || (*ptr == '+'))
+    ptr++;
+
+  long whole = 0;
+  int digits = 0;
+  for (; (*ptr >= '0') && (*ptr <= '9'); ptr++, digits++)
+  {
+    whole = whole * 10 + (*ptr - '0');
+    if (whole > 1000000L) return (false);   // way out of any range
+  }
+
+  long frac = 0;
+  if (*ptr == '.')
+  {
+    int scale = 10;
+    for (ptr++; (*ptr >= '0') && (*ptr <= '9'); ptr++, digits++)
+    {
+      frac += (*ptr - '0') * scale;
+      scale /= 10;
+    }
+  }
+
+  if ((digits == 0) || (*ptr != '\0'))
+    return (false);
+  *val = whole * 100 + frac;
+  if (neg) *val = -*val;
+  return (true);
+}
@@ -1,6 +1,9 @@
 #include "Prefs.h"
 #include "SerialCmd.h"
 #include "Servos.h"
+#include "Kinematics.h"
+#include "Macros.h"
+#include "Stats.h"
 // NOTE: THIS WORKS AROUND A LIBRARY PRESENT BUG - DO NOT REMOVE
 // (even if we don't use SPI)
 #include "SPI.h"
@@ -11,7 +14,7 @@ Prefs     prefs;
 
 
 /**
- * @brief Convert servo number (see config.h)
+ * @brief Convert servo number (see ServoList.h)
  * to a string.
  * 
  * @param id 
@@ -19,52 +22,28 @@ Prefs     prefs;
  */
 String ServoToName(int id)
 {
-  String res=" ";
-  switch (id)
-  {
-  case (JAW_SERVO):
-    res = "JAW";
-    break;
-
-  case (ROT_SERVO):
-    res = "ROT";
-    break;
-
-  case (LEFT_SERVO):
-    res = "LEFT";
-    break;
-
-  case (RIGHT_SERVO):
-    res = "RIGHT";
-    break;
-
-  case (LEYE_SERVO):
-    res = "LEYE";
-    break;
-
-  case (REYE_SERVO):
-    res = "REYE";
-    break;
-
-  default:
-    res = "*** ERROR in ServoToName...UNKNOWN SERVO ID";
-    break;
-  }
-  return(res);
+  if ((id < 0) || (id >= NO_OF_SERVOS))
+    return ("*** ERROR in ServoToName...UNKNOWN SERVO ID");
+  return (servoTable[id].name);
 }
 
 void setup() {
   // put your setup code here, to run once:
-  Serial.begin(115200); 
+  Serial.setRxBufferSize(SERIAL_RX_BUF_LEN);
+  Serial.begin(BAUD_DEF); 
   Serial.println("Initialization");
+  Stats::begin();
   vTaskDelay(500);
   prefs.setup();
   servos.begin();
+  Kinematics::begin();   // (after prefs - builds the pose table)
   usbcmds.begin();
+  Macros::begin();   // after every module has added its commands
 }
 
 
 void loop() {
   // put your main code here, to run repeatedly:
   usbcmds.loop();  
+  servos.loop();
 }
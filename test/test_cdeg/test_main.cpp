@@ -0,0 +1,98 @@
+/**
+ * @file test_main.cpp
+ * @brief  Host tests: decimal degrees to centidegrees (decodeCdeg)
+ *   (pio test -e native)
+ */
+#include <unity.h>
+#include "Tokenizer.h"
+
+void setUp() {}
+void tearDown() {}
+
+
+static void good(const char *text, long expect)
+{
+  long val = 99999;
+  TEST_ASSERT_TRUE(Tokenizer::decodeCdeg(text, &val));
+  TEST_ASSERT_EQUAL_INT32(expect, val);
+}
+
+
+static void bad(const char *text)
+{
+  long val = 99999;
+  TEST_ASSERT_FALSE(Tokenizer::decodeCdeg(text, &val));
+  TEST_ASSERT_EQUAL_INT32(99999, val);   // untouched
+}
+
+
+void test_whole_degrees()
+{
+  good("0", 0);
+  good("12", 1200);
+  good("-12", -1200);
+  good("+45", 4500);
+  good("180", 18000);
+}
+
+
+void test_decimals()
+{
+  good("7.5", 750);
+  good("45.25", 4525);
+  good("0.05", 5);
+  good("-0.5", -50);
+  good("-12.05", -1205);
+}
+
+
+void test_bare_point()
+{
+  good(".5", 50);
+  good("12.", 1200);
+}
+
+
+void test_extra_decimals_are_dropped()
+{
+  good("1.239", 123);
+  good("-1.239", -123);   // (toward zero)
+  good("1.0099999999", 100);
+}
+
+
+void test_not_numbers()
+{
+  bad("");
+  bad("-");
+  bad("+");
+  bad(".");
+  bad("-.");
+  bad("12a");
+  bad("1.2.3");
+  bad("1e3");
+  bad(" 12");
+  bad("12 ");
+  bad("--1");
+  bad("RIGHT");
+}
+
+
+void test_way_out_of_range()
+{
+  bad("10000000");
+  bad("-99999999999999999999");
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_whole_degrees);
+  RUN_TEST(test_decimals);
+  RUN_TEST(test_bare_point);
+  RUN_TEST(test_extra_decimals_are_dropped);
+  RUN_TEST(test_not_numbers);
+  RUN_TEST(test_way_out_of_range);
+  return (UNITY_END());
+}
@@ -0,0 +1,222 @@
+/**
+ * @file test_main.cpp
+ * @brief  Host tests: COBS framing, the frame CRC, and over-long frames
+ *   (pio test -e native)
+ */
+#include <unity.h>
+#include <string.h>
+#include "Cobs.h"
+
+void setUp() {}
+void tearDown() {}
+
+
+// Encode, check there is no 0x00 in the result, decode, compare
+static void roundTrip(const uint8_t *data, int len)
+{
+  uint8_t enc[400];
+  int encLen = Cobs::encode(data, len, enc);
+  TEST_ASSERT_LESS_OR_EQUAL(len + 1 + len / 254, encLen);
+  for (int idx = 0; idx < encLen; idx++)
+    TEST_ASSERT_NOT_EQUAL(0, enc[idx]);
+  TEST_ASSERT_EQUAL_INT(len, Cobs::decode(enc, encLen));
+  if (len > 0)
+    TEST_ASSERT_EQUAL_MEMORY(data, enc, len);
+}
+
+
+// Build a frame (payload + CRC, encoded) - returns its encoded length
+static int makeFrame(const uint8_t *payload, int len, uint8_t *out)
+{
+  uint8_t raw[64];
+  memcpy(raw, payload, len);
+  uint16_t crc = Cobs::crc16(payload, len);
+  raw[len] = crc & 0xff;
+  raw[len + 1] = crc >> 8;
+  return (Cobs::encode(raw, len + 2, out));
+}
+
+
+void test_encode_known_vector()
+{
+  const uint8_t data[] = {0x11, 0x22, 0x00, 0x33};
+  const uint8_t expect[] = {0x03, 0x11, 0x22, 0x02, 0x33};
+  uint8_t enc[8];
+  TEST_ASSERT_EQUAL_INT(sizeof(expect), Cobs::encode(data, sizeof(data), enc));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expect, enc, sizeof(expect));
+}
+
+
+void test_round_trip()
+{
+  const uint8_t zeros[] = {0, 0, 0};
+  const uint8_t mixed[] = {0x10, 0x00, 0x05, 0xff, 0x00};
+  const uint8_t single[] = {0x42};
+  roundTrip(zeros, sizeof(zeros));
+  roundTrip(mixed, sizeof(mixed));
+  roundTrip(single, sizeof(single));
+  roundTrip(single, 0);
+}
+
+
+void test_round_trip_long_runs()
+{
+  uint8_t data[300];
+  for (int idx = 0; idx < (int)sizeof(data); idx++)
+    data[idx] = (idx % 7 == 6) ? 0 : (idx & 0xff) | 1;
+  roundTrip(data, sizeof(data));
+
+  // 254 and 255 non-zero bytes: the 0xff code, with and without a tail
+  memset(data, 0xa5, sizeof(data));
+  roundTrip(data, 254);
+  roundTrip(data, 255);
+  roundTrip(data, 300);
+}
+
+
+void test_decode_bad_encoding()
+{
+  uint8_t zeroCode[] = {0x02, 0x11, 0x00, 0x22};
+  TEST_ASSERT_EQUAL_INT(-1, Cobs::decode(zeroCode, sizeof(zeroCode)));
+
+  uint8_t truncated[] = {0x05, 0x11, 0x22};   // says 4 bytes follow
+  TEST_ASSERT_EQUAL_INT(-1, Cobs::decode(truncated, sizeof(truncated)));
+}
+
+
+void test_crc_known_vector()
+{
+  // CRC-16/CCITT-FALSE check value
+  const char *check = "123456789";
+  TEST_ASSERT_EQUAL_HEX16(0x29b1, Cobs::crc16((const uint8_t *)check, 9));
+  TEST_ASSERT_EQUAL_HEX16(0xffff, Cobs::crc16((const uint8_t *)check, 0));
+}
+
+
+void test_unframe_good()
+{
+  const uint8_t payload[] = {0x15, 0x02, 0x00, 0x10};   // angle 2 4096
+  uint8_t frame[BIN_BUF_LEN];
+  int len = makeFrame(payload, sizeof(payload), frame);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), Cobs::unframe(frame, len));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, frame, sizeof(payload));
+}
+
+
+void test_unframe_rejects_bad_crc()
+{
+  const uint8_t payload[] = {0x10, 0x03, 0xdc, 0x05};
+  for (int byte = 0; byte < (int)sizeof(payload) + 2; byte++)
+  {
+    for (int bit = 0; bit < 8; bit++)
+    {
+      uint8_t raw[sizeof(payload) + 2];
+      uint8_t frame[BIN_BUF_LEN];
+      memcpy(raw, payload, sizeof(payload));
+      uint16_t crc = Cobs::crc16(payload, sizeof(payload));
+      raw[sizeof(payload)] = crc & 0xff;
+      raw[sizeof(payload) + 1] = crc >> 8;
+      raw[byte] ^= (1 << bit);   // one bit flipped on the way
+      int len = Cobs::encode(raw, sizeof(raw), frame);
+      TEST_ASSERT_EQUAL_INT(COBS_BAD_CRC, Cobs::unframe(frame, len));
+    }
+  }
+}
+
+
+void test_unframe_too_short()
+{
+  uint8_t empty[] = {0x01};                  // decodes to nothing
+  TEST_ASSERT_EQUAL_INT(COBS_BAD, Cobs::unframe(empty, sizeof(empty)));
+  uint8_t opOnly[] = {0x02, 0x12};           // an opcode, no CRC
+  TEST_ASSERT_EQUAL_INT(COBS_BAD_CRC, Cobs::unframe(opOnly, sizeof(opOnly)));
+  TEST_ASSERT_EQUAL_INT(0x12, opOnly[0]);    // (the error reply can name it)
+  uint8_t bad[] = {0x03, 0x12};              // bad COBS
+  TEST_ASSERT_EQUAL_INT(COBS_BAD, Cobs::unframe(bad, sizeof(bad)));
+}
+
+
+// Feed a whole frame (delimiters included) - returns the last event
+static CobsRx::rxEvent_t feed(CobsRx *rx, const uint8_t *frame, int len)
+{
+  rx->push(BIN_FRAME_DELIM);
+  for (int idx = 0; idx < len; idx++)
+    rx->push(frame[idx]);
+  return (rx->push(BIN_FRAME_DELIM));
+}
+
+
+void test_rx_collects_a_frame()
+{
+  const uint8_t payload[] = {0x12};
+  uint8_t frame[BIN_BUF_LEN];
+  int len = makeFrame(payload, sizeof(payload), frame);
+
+  CobsRx rx;
+  TEST_ASSERT_FALSE(rx.active());
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_START, rx.push(BIN_FRAME_DELIM));
+  TEST_ASSERT_TRUE(rx.active());
+  for (int idx = 0; idx < len; idx++)
+    TEST_ASSERT_EQUAL_INT(CobsRx::RX_NONE, rx.push(frame[idx]));
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_FRAME, rx.push(BIN_FRAME_DELIM));
+  TEST_ASSERT_FALSE(rx.active());
+  TEST_ASSERT_EQUAL_INT(len, rx.len);
+  TEST_ASSERT_EQUAL_INT(1, Cobs::unframe(rx.buf, rx.len));
+  TEST_ASSERT_EQUAL_INT(0x12, rx.buf[0]);
+}
+
+
+void test_rx_empty_frame_resyncs()
+{
+  CobsRx rx;
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_START, rx.push(BIN_FRAME_DELIM));
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_START, rx.push(BIN_FRAME_DELIM));
+  TEST_ASSERT_TRUE(rx.active());
+}
+
+
+void test_rx_longest_frame_fits()
+{
+  uint8_t frame[BIN_BUF_LEN];
+  memset(frame, 0x33, sizeof(frame));
+  CobsRx rx;
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_FRAME, feed(&rx, frame, BIN_BUF_LEN));
+  TEST_ASSERT_EQUAL_INT(BIN_BUF_LEN, rx.len);
+}
+
+
+void test_rx_drops_over_long_frame()
+{
+  CobsRx rx;
+  rx.push(BIN_FRAME_DELIM);
+  for (int idx = 0; idx < BIN_BUF_LEN; idx++)
+    TEST_ASSERT_EQUAL_INT(CobsRx::RX_NONE, rx.push(0x44));
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_DROPPED, rx.push(0x44));
+  TEST_ASSERT_FALSE(rx.active());   // back to text
+
+  // ... and the next frame still gets through
+  const uint8_t payload[] = {0x13};
+  uint8_t frame[BIN_BUF_LEN];
+  int len = makeFrame(payload, sizeof(payload), frame);
+  TEST_ASSERT_EQUAL_INT(CobsRx::RX_FRAME, feed(&rx, frame, len));
+  TEST_ASSERT_EQUAL_INT(1, Cobs::unframe(rx.buf, rx.len));
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_encode_known_vector);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_round_trip_long_runs);
+  RUN_TEST(test_decode_bad_encoding);
+  RUN_TEST(test_crc_known_vector);
+  RUN_TEST(test_unframe_good);
+  RUN_TEST(test_unframe_rejects_bad_crc);
+  RUN_TEST(test_unframe_too_short);
+  RUN_TEST(test_rx_collects_a_frame);
+  RUN_TEST(test_rx_empty_frame_resyncs);
+  RUN_TEST(test_rx_longest_frame_fits);
+  RUN_TEST(test_rx_drops_over_long_frame);
+  return (UNITY_END());
+}
@@ -0,0 +1,163 @@
+/**
+ * @file test_main.cpp
+ * @brief  Host tests: integer math (FixMath.h) - the square root, and
+ *   the bilinear interpolation behind Kinematics::lookup
+ *   (pio test -e native)
+ */
+#include <unity.h>
+#include "FixMath.h"
+
+void setUp() {}
+void tearDown() {}
+
+
+// floor(sqrt(val)):  r*r <= val < (r+1)*(r+1)
+static void checkSqrt(uint64_t val)
+{
+    uint64_t res = isqrt(val);
+    TEST_ASSERT_TRUE(res * res <= val);
+    uint64_t next = res + 1;
+    if (next < (1ULL << 32))
+        TEST_ASSERT_TRUE(next * next > val);
+    else
+        TEST_ASSERT_EQUAL_UINT32(0xffffffffu, (uint32_t)res);
+}
+
+
+void test_isqrt_small()
+{
+    const uint32_t expect[] = {0, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 4};
+    for (uint32_t val = 0; val < sizeof(expect) / sizeof(expect[0]); val++)
+        TEST_ASSERT_EQUAL_UINT32(expect[val], isqrt(val));
+}
+
+
+void test_isqrt_squares_and_neighbours()
+{
+    for (uint64_t root = 1; root < 70000; root += 7)
+    {
+        TEST_ASSERT_EQUAL_UINT32(root, isqrt(root * root));
+        TEST_ASSERT_EQUAL_UINT32(root - 1, isqrt(root * root - 1));
+        TEST_ASSERT_EQUAL_UINT32(root, isqrt(root * root + 1));
+    }
+}
+
+
+void test_isqrt_large()
+{
+    const uint64_t max32 = 0xffffffffULL;
+    TEST_ASSERT_EQUAL_UINT32(0xffffffffu, isqrt(max32 * max32));
+    TEST_ASSERT_EQUAL_UINT32(0xfffffffeu, isqrt(max32 * max32 - 1));
+    TEST_ASSERT_EQUAL_UINT32(0xffffffffu, isqrt(0xffffffffffffffffULL));
+    TEST_ASSERT_EQUAL_UINT32(1u << 31, isqrt(1ULL << 62));
+    checkSqrt(1ULL << 63);
+}
+
+
+void test_isqrt_spread()
+{
+    uint64_t val = 1;
+    for (int idx = 0; idx < 2000; idx++)
+    {
+        checkSqrt(val);
+        val = val * 6364136223846793005ULL + 1442695040888963407ULL;   // (LCG)
+    }
+}
+
+
+void test_isqrt_braking_range()
+{
+    // The profile's braking speed: sqrt(a*a + 8*a*d), with a and d in
+    //   centidegrees << PROF_SHIFT per tick - up to ~2^50
+    for (uint64_t val = 1ULL << 40; val < (1ULL << 52); val = val * 3 + 12345)
+        checkSqrt(val);
+}
+
+
+void test_divround()
+{
+    TEST_ASSERT_EQUAL_INT32(0, (int32_t)divRound(0, 100));
+    TEST_ASSERT_EQUAL_INT32(2, (int32_t)divRound(249, 100));
+    TEST_ASSERT_EQUAL_INT32(3, (int32_t)divRound(250, 100));
+    TEST_ASSERT_EQUAL_INT32(-2, (int32_t)divRound(-249, 100));
+    TEST_ASSERT_EQUAL_INT32(-3, (int32_t)divRound(-250, 100));   // (symmetric about 0)
+    TEST_ASSERT_EQUAL_INT32(7, (int32_t)divRound(7, 1));
+}
+
+
+#define SPAN 200    // (KIN_STEP_DEG, in centidegrees)
+
+void test_bilerp_corners()
+{
+    const int32_t c00 = 1000, c10 = -2000, c01 = 3000, c11 = -4000;
+    TEST_ASSERT_EQUAL_INT32(c00, bilerp(c00, c10, c01, c11, 0, 0, SPAN));
+    TEST_ASSERT_EQUAL_INT32(c10, bilerp(c00, c10, c01, c11, SPAN, 0, SPAN));
+    TEST_ASSERT_EQUAL_INT32(c01, bilerp(c00, c10, c01, c11, 0, SPAN, SPAN));
+    TEST_ASSERT_EQUAL_INT32(c11, bilerp(c00, c10, c01, c11, SPAN, SPAN, SPAN));
+    // centre - the average of the four
+    TEST_ASSERT_EQUAL_INT32(-500, bilerp(c00, c10, c01, c11, SPAN / 2, SPAN / 2, SPAN));
+}
+
+
+void test_bilerp_edges_are_linear()
+{
+    for (int32_t x = 0; x <= SPAN; x += 25)
+    {
+        // along y=0 only c00 and c10 count
+        TEST_ASSERT_EQUAL_INT32(x * 4, bilerp(0, SPAN * 4, 9999, -9999, x, 0, SPAN));
+        // along x=0 only c00 and c01 count
+        TEST_ASSERT_EQUAL_INT32(-x * 2, bilerp(0, 9999, -SPAN * 2, -9999, 0, x, SPAN));
+    }
+}
+
+
+void test_bilerp_plane_is_exact()
+{
+    // f = 100 + 3x - 2y is reproduced exactly anywhere in the cell
+    const int32_t c00 = 100, c10 = 100 + 3 * SPAN, c01 = 100 - 2 * SPAN;
+    const int32_t c11 = 100 + 3 * SPAN - 2 * SPAN;
+    for (int32_t x = 0; x <= SPAN; x += 17)
+        for (int32_t y = 0; y <= SPAN; y += 13)
+            TEST_ASSERT_EQUAL_INT32(100 + 3 * x - 2 * y, bilerp(c00, c10, c01, c11, x, y, SPAN));
+}
+
+
+void test_bilerp_rounds_to_nearest()
+{
+    // one third of the way along: 10/3 -> 3, 20/3 -> 7, -20/3 -> -7
+    TEST_ASSERT_EQUAL_INT32(3, bilerp(0, 10, 0, 10, 1, 0, 3));
+    TEST_ASSERT_EQUAL_INT32(7, bilerp(0, 20, 0, 20, 1, 0, 3));
+    TEST_ASSERT_EQUAL_INT32(-7, bilerp(0, -20, 0, -20, 1, 0, 3));
+}
+
+
+void test_bilerp_stays_in_range()
+{
+    // table entries are int16 - the result never leaves the corners' range
+    for (int32_t x = 0; x <= SPAN; x += 50)
+        for (int32_t y = 0; y <= SPAN; y += 50)
+        {
+            int32_t val = bilerp(32767, -32768, 32767, -32768, x, y, SPAN);
+            TEST_ASSERT_TRUE(val <= 32767 && val >= -32768);
+            val = bilerp(32767, 32767, 32767, 32767, x, y, SPAN);
+            TEST_ASSERT_EQUAL_INT32(32767, val);
+        }
+}
+
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_isqrt_small);
+    RUN_TEST(test_isqrt_squares_and_neighbours);
+    RUN_TEST(test_isqrt_large);
+    RUN_TEST(test_isqrt_spread);
+    RUN_TEST(test_isqrt_braking_range);
+    RUN_TEST(test_divround);
+    RUN_TEST(test_bilerp_corners);
+    RUN_TEST(test_bilerp_edges_are_linear);
+    RUN_TEST(test_bilerp_plane_is_exact);
+    RUN_TEST(test_bilerp_rounds_to_nearest);
+    RUN_TEST(test_bilerp_stays_in_range);
+    return (UNITY_END());
+}
@@ -0,0 +1,102 @@
+/**
+ * @file test_main.cpp
+ * @brief  Host tests: splitting a line into commands at ';'
+ *   (pio test -e native)
+ */
+#include <unity.h>
+#include <string.h>
+#include "Tokenizer.h"
+
+#define MAX_CMDS  4
+
+static char line[160];
+static char *cmds[MAX_CMDS];
+
+void setUp() {}
+void tearDown() {}
+
+
+static int split(const char *text, int maxCmds = MAX_CMDS)
+{
+  strcpy(line, text);
+  return (Tokenizer::splitLine(line, cmds, maxCmds));
+}
+
+
+void test_one_command()
+{
+  TEST_ASSERT_EQUAL_INT(1, split("servo RIGHT 1500"));
+  TEST_ASSERT_EQUAL_STRING("servo RIGHT 1500", cmds[0]);
+  TEST_ASSERT_EQUAL_INT(1, split(""));
+  TEST_ASSERT_EQUAL_STRING("", cmds[0]);
+}
+
+
+void test_several_commands()
+{
+  TEST_ASSERT_EQUAL_INT(3, split("jaw 10;leye 5 ; reye 5"));
+  TEST_ASSERT_EQUAL_STRING("jaw 10", cmds[0]);
+  TEST_ASSERT_EQUAL_STRING("leye 5 ", cmds[1]);
+  TEST_ASSERT_EQUAL_STRING(" reye 5", cmds[2]);
+}
+
+
+void test_empty_commands()
+{
+  // (an empty command tokenizes to nothing - it is skipped)
+  TEST_ASSERT_EQUAL_INT(3, split(";jaw 10;"));
+  TEST_ASSERT_EQUAL_STRING("", cmds[0]);
+  TEST_ASSERT_EQUAL_STRING("jaw 10", cmds[1]);
+  TEST_ASSERT_EQUAL_STRING("", cmds[2]);
+  TEST_ASSERT_EQUAL_INT(2, split(";"));
+}
+
+
+void test_separator_inside_quotes()
+{
+  TEST_ASSERT_EQUAL_INT(2, split("ssid \"a;b\";jaw 10"));
+  TEST_ASSERT_EQUAL_STRING("ssid \"a;b\"", cmds[0]);
+  TEST_ASSERT_EQUAL_STRING("jaw 10", cmds[1]);
+  TEST_ASSERT_EQUAL_INT(2, split("pass 'x;\"y';rot 5"));
+  TEST_ASSERT_EQUAL_STRING("pass 'x;\"y'", cmds[0]);
+}
+
+
+void test_unterminated_quote_keeps_the_rest()
+{
+  TEST_ASSERT_EQUAL_INT(2, split("jaw 1;ssid \"a;b;c"));
+  TEST_ASSERT_EQUAL_STRING("ssid \"a;b;c", cmds[1]);
+}
+
+
+void test_last_command_gets_the_rest()
+{
+  TEST_ASSERT_EQUAL_INT(2, split("a;b;c;d", 2));
+  TEST_ASSERT_EQUAL_STRING("a", cmds[0]);
+  TEST_ASSERT_EQUAL_STRING("b;c;d", cmds[1]);
+}
+
+
+void test_split_then_tokenize()
+{
+  char *tokens[4];
+  TEST_ASSERT_EQUAL_INT(2, split("macro run \"a; b\"; jaw 10"));
+  TEST_ASSERT_EQUAL_INT(3, Tokenizer::tokenize(cmds[0], tokens, 4));
+  TEST_ASSERT_EQUAL_STRING("a; b", tokens[2]);
+  TEST_ASSERT_EQUAL_INT(2, Tokenizer::tokenize(cmds[1], tokens, 4));
+  TEST_ASSERT_EQUAL_STRING("jaw", tokens[0]);
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_one_command);
+  RUN_TEST(test_several_commands);
+  RUN_TEST(test_empty_commands);
+  RUN_TEST(test_separator_inside_quotes);
+  RUN_TEST(test_unterminated_quote_keeps_the_rest);
+  RUN_TEST(test_last_command_gets_the_rest);
+  RUN_TEST(test_split_then_tokenize);
+  return (UNITY_END());
+}
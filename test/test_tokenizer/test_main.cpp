@@ -0,0 +1,136 @@
+/**
+ * @file test_main.cpp
+ * @brief  Host tests: the in-place tokenizer (separators and quotes)
+ *   (pio test -e native)
+ */
+#include <unity.h>
+#include <string.h>
+#include "Tokenizer.h"
+
+#define MAX_TOK  8
+
+static char line[160];
+static char *tokens[MAX_TOK];
+
+void setUp() {}
+void tearDown() {}
+
+
+static int tok(const char *text, int maxTokens = MAX_TOK)
+{
+  strcpy(line, text);
+  return (Tokenizer::tokenize(line, tokens, maxTokens));
+}
+
+
+void test_blank_lines()
+{
+  TEST_ASSERT_EQUAL_INT(0, tok(""));
+  TEST_ASSERT_EQUAL_INT(0, tok("   "));
+  TEST_ASSERT_EQUAL_INT(0, tok(" , ,"));
+}
+
+
+void test_separators()
+{
+  TEST_ASSERT_EQUAL_INT(4, tok("  servo RIGHT,,  1500 , x  "));
+  TEST_ASSERT_EQUAL_STRING("servo", tokens[0]);
+  TEST_ASSERT_EQUAL_STRING("RIGHT", tokens[1]);
+  TEST_ASSERT_EQUAL_STRING("1500", tokens[2]);
+  TEST_ASSERT_EQUAL_STRING("x", tokens[3]);
+}
+
+
+void test_tokens_point_into_the_line()
+{
+  TEST_ASSERT_EQUAL_INT(2, tok("ab cd"));
+  TEST_ASSERT_TRUE(tokens[0] == &line[0]);
+  TEST_ASSERT_TRUE(tokens[1] == &line[3]);
+}
+
+
+void test_quoted_token_keeps_separators()
+{
+  TEST_ASSERT_EQUAL_INT(3, tok("macro record \"wave, then nod\""));
+  TEST_ASSERT_EQUAL_STRING("wave, then nod", tokens[2]);
+  TEST_ASSERT_EQUAL_INT(2, tok("ssid 'my net'"));
+  TEST_ASSERT_EQUAL_STRING("my net", tokens[1]);
+}
+
+
+void test_other_quote_is_plain_text()
+{
+  TEST_ASSERT_EQUAL_INT(2, tok("name \"it's\""));
+  TEST_ASSERT_EQUAL_STRING("it's", tokens[1]);
+}
+
+
+void test_empty_quoted_token()
+{
+  TEST_ASSERT_EQUAL_INT(3, tok("pass \"\" x"));
+  TEST_ASSERT_EQUAL_STRING("", tokens[1]);
+  TEST_ASSERT_EQUAL_STRING("x", tokens[2]);
+}
+
+
+void test_unterminated_quote_runs_to_end()
+{
+  TEST_ASSERT_EQUAL_INT(2, tok("ssid \"open net , x"));
+  TEST_ASSERT_EQUAL_STRING("open net , x", tokens[1]);
+}
+
+
+void test_closing_quote_ends_the_token()
+{
+  TEST_ASSERT_EQUAL_INT(2, tok("\"a b\"c"));
+  TEST_ASSERT_EQUAL_STRING("a b", tokens[0]);
+  TEST_ASSERT_EQUAL_STRING("c", tokens[1]);
+}
+
+
+void test_quote_inside_a_token_is_plain_text()
+{
+  TEST_ASSERT_EQUAL_INT(2, tok("ab\"cd ef"));
+  TEST_ASSERT_EQUAL_STRING("ab\"cd", tokens[0]);
+  TEST_ASSERT_EQUAL_STRING("ef", tokens[1]);
+}
+
+
+void test_extra_tokens_are_ignored()
+{
+  TEST_ASSERT_EQUAL_INT(2, tok("a b c d", 2));
+  TEST_ASSERT_EQUAL_STRING("a", tokens[0]);
+  TEST_ASSERT_EQUAL_STRING("b", tokens[1]);
+}
+
+
+void test_reentrant()
+{
+  char first[] = "one two";
+  char second[] = "three four";
+  char *tokA[2], *tokB[2];
+  TEST_ASSERT_EQUAL_INT(2, Tokenizer::tokenize(first, tokA, 2));
+  TEST_ASSERT_EQUAL_INT(2, Tokenizer::tokenize(second, tokB, 2));
+  TEST_ASSERT_EQUAL_STRING("one", tokA[0]);
+  TEST_ASSERT_EQUAL_STRING("two", tokA[1]);
+  TEST_ASSERT_EQUAL_STRING("three", tokB[0]);
+  TEST_ASSERT_EQUAL_STRING("four", tokB[1]);
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_lines);
+  RUN_TEST(test_separators);
+  RUN_TEST(test_tokens_point_into_the_line);
+  RUN_TEST(test_quoted_token_keeps_separators);
+  RUN_TEST(test_other_quote_is_plain_text);
+  RUN_TEST(test_empty_quoted_token);
+  RUN_TEST(test_unterminated_quote_runs_to_end);
+  RUN_TEST(test_closing_quote_ends_the_token);
+  RUN_TEST(test_quote_inside_a_token_is_plain_text);
+  RUN_TEST(test_extra_tokens_are_ignored);
+  RUN_TEST(test_reentrant);
+  return (UNITY_END());
+}